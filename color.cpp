@@ -22,14 +22,43 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "./color.h"
 
+#include "M480.h"
+
 namespace color {
 
+gradient::gradient(std::span<const vector::float4> _stops) {
+    stops_n = std::min(_stops.size(), stops_max);
+    for (size_t c = 0; c < stops_n; c++) {
+        stops[c] = _stops[c];
+    }
+    // Pad to a flat segment so sample() always has one
+    for ( ; stops_n < 2; stops_n++) {
+        stops[stops_n] = stops_n ? stops[0] : vector::float4();
+    }
+    for (size_t c = 0; c + 1 < stops_n; c++) {
+        float d = stops[c+1].w - stops[c].w;
+        stops_rcp[c] = ( d != 0.0f ) ? ( 1.0f / d ) : 0.0f;
+    }
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+vector::float4 gradient::sample(float i) const {
+    // Outside of the stops the first or last segment extrapolates
+    size_t d = 0;
+    for (size_t c = stops_n - 2; c > 0; c--) {
+        if (i >= stops[c].w) {
+            d = c;
+            break;
+        }
+    }
+    return vector::float4::lerp(stops[d], stops[d+1], (i - stops[d].w) * stops_rcp[d]);
+}
+
 __attribute__ ((hot, optimize("Os"), flatten))
 vector::float4 gradient::repeat(float i) const {
     i = fabsf(i);
     i -= truncf(i);
-    i *= colors_mul;
-    return vector::float4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], i - truncf(i));
+    return sample(i);
 }
 
 __attribute__ ((hot, optimize("Os"), flatten))
@@ -41,20 +70,47 @@ vector::float4 gradient::reflect(float i) const {
         i -= truncf(i);
         i = 1.0f - i;
     }
-    i *= colors_mul;
-    return vector::float4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], i - truncf(i));
+    return sample(i);
 }
 
 __attribute__ ((hot, optimize("Os"), flatten))
 vector::float4 gradient::clamp(float i) const {
-    if (i <= 0.0f) {
-        return colors[0];
+    return sample(std::clamp(i, 0.0f, 1.0f));
+}
+
+static uint32_t frac_to_q32(float v) {
+    v -= floorf(v);
+    return uint32_t(int64_t(v * 4294967296.0f));
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void gradient::repeat(std::span<vector::float4> out, float phase, float step) const {
+    uint32_t p = frac_to_q32(phase);
+    uint32_t s = frac_to_q32(step);
+    for (vector::float4 &o : out) {
+        o = sample(float(p) * ( 1.0f / 4294967296.0f ));
+        p += s;
     }
-    if (i >= 1.0f) {
-        return colors[colors_n-1];
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void gradient::reflect(std::span<vector::float4> out, float phase, float step) const {
+    uint32_t p = frac_to_q32(phase * 0.5f);
+    uint32_t s = frac_to_q32(step * 0.5f);
+    for (vector::float4 &o : out) {
+        // Fold [1,2) back onto (1,0]
+        uint32_t q = ( p & 0x80000000 ) ? ( 0U - p ) : p;
+        o = sample(float(q) * ( 1.0f / 2147483648.0f ));
+        p += s;
+    }
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void gradient::clamp(std::span<vector::float4> out, std::span<const float> in) const {
+    size_t n = std::min(out.size(), in.size());
+    for (size_t c = 0; c < n; c++) {
+        out[c] = sample(std::clamp(in[c], 0.0f, 1.0f));
     }
-    i *= colors_mul;
-    return vector::float4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], i - truncf(i));
 }
 
 __attribute__ ((hot, optimize("Os"), flatten))
@@ -157,4 +213,109 @@ vector::float4 convert::OKLAB2LED(const vector::float4 &in) const {
     return vector::float4(r,g,b).clamp();
 }
 
+vector::float4 srgb8_cached(const rgba<uint8_t> &color) {
+    static constexpr size_t cache_n = 4;
+    static std::array<rgba<uint8_t>, cache_n> keys;
+    static std::array<vector::float4, cache_n> values;
+    static size_t valid = 0;
+    static size_t next = 0;
+
+    rgba<uint8_t> key(color.r, color.g, color.b);
+    for (size_t c = 0; c < valid; c++) {
+        if (keys[c] == key) {
+            return values[c];
+        }
+    }
+
+    vector::float4 value(srgb8_convert.sRGB2OKLAB(key));
+    keys[next] = key;
+    values[next] = value;
+    next = ( next + 1 ) % cache_n;
+    valid = std::max(valid, next == 0 ? cache_n : next);
+    return value;
+}
+
+void led_transfer::set(float _brightness) {
+    if (brightness == _brightness) {
+        return;
+    }
+    brightness = _brightness;
+
+    for (size_t c = 0; c <= lut_n; c++) {
+        float l = brightness * float(c) * ( 1.0f / float(lut_n) );
+        float Y = ( l + 0.16f ) * (1.0f / 1.16f);
+        float y = ( l <= 0.08f ) ? ( l * 0.1107056f ) : ( Y * Y * Y );
+        lut[c] = int32_t(y * 1073741824.0f + 0.5f);
+    }
+
+    // vp_13l > 1/65536 on the brightness scaled input
+    vp_min_13l = int32_t(std::min(2048.0f / brightness, 1073741824.0f));
+}
+
+__attribute__ ((hot, optimize("O2"), flatten))
+void convert::OKLAB2WS2816(const vector::float4 *in, rgba<uint16_t> *out, size_t n, const led_transfer &transfer) const {
+    // Same math as OKLAB2LED, but in fixed point:
+    // - Inputs are quantized to Q15 at full scale. Brightness only scales Y, the
+    //   u'/v' ratios are invariant, so it is applied through the per level lightness LUT.
+    // - u'13L and v'13L are one SMLAD each (Q15 * Q12 -> Q27).
+    // - The only division is normalized with CLZ and done with SDIV.
+    // - XYZ is Q28, the XYZ->RGB matrix is Q12 and accumulated with SMLAL, result is Q16.
+    // - The 384 knee is applied on the saturated 16-bit result.
+    static constexpr uint32_t up_coeff = (uint32_t(4096) << 16) | uint32_t(0.197839825f * 13.0f * 4096.0f + 0.5f);
+    static constexpr uint32_t vp_coeff = (uint32_t(4096) << 16) | uint32_t(0.468336303f * 13.0f * 4096.0f + 0.5f);
+
+    static constexpr int32_t m[3][3] = {
+        { int32_t( 3.2404542f * 4096.0f + 0.5f), int32_t(-1.5371385f * 4096.0f - 0.5f), int32_t(-0.4985314f * 4096.0f - 0.5f) },
+        { int32_t(-0.9692660f * 4096.0f - 0.5f), int32_t( 1.8760108f * 4096.0f + 0.5f), int32_t( 0.0415560f * 4096.0f + 0.5f) },
+        { int32_t( 0.0556434f * 4096.0f + 0.5f), int32_t(-0.2040259f * 4096.0f - 0.5f), int32_t( 1.0572252f * 4096.0f + 0.5f) }
+    };
+
+    auto to_q28 = [](int64_t v, int32_t shift) {
+        v = shift >= 0 ? ( v >> shift ) : ( v << -shift );
+        return int32_t(std::clamp(v, int64_t(INT32_MIN), int64_t(INT32_MAX)));
+    };
+
+    auto to_ws2816 = [](int64_t v) {
+        uint32_t c = uint32_t(__builtin_arm_usat(int32_t(std::clamp(v >> 24, int64_t(INT32_MIN), int64_t(INT32_MAX))), 16));
+        return uint16_t(c < 384 ? ( ( c * 256 ) / 384 ) : c);
+    };
+
+    const int32_t vp_min = transfer.vp_min();
+
+    for (size_t c = 0; c < n; c++) {
+        int32_t l = __builtin_arm_ssat(int32_t(in[c].x * 32768.0f), 16);
+        int32_t u = __builtin_arm_ssat(int32_t(in[c].y * 32768.0f), 16);
+        int32_t v = __builtin_arm_ssat(int32_t(in[c].z * 32768.0f), 16);
+
+        int32_t up_13l = int32_t(__SMLAD(__PKHBT(uint32_t(l), uint32_t(u), 16), up_coeff, 0));
+        int32_t vp_13l = int32_t(__SMLAD(__PKHBT(uint32_t(l), uint32_t(v), 16), vp_coeff, 0));
+
+        int32_t y30 = transfer.y30(l);
+
+        int32_t x28 = 0;
+        int32_t z28 = 0;
+        if (vp_13l > vp_min && y30 != 0) {
+            uint32_t ay = uint32_t(y30 < 0 ? -y30 : y30);
+            int32_t ny = int32_t(__CLZ(ay)) - 2;
+            int32_t nv = std::max(int32_t(0), 16 - int32_t(__CLZ(uint32_t(vp_13l))));
+            // k = y / vp, Q(3 + ny + nv)
+            int32_t k = int32_t(( ay << ny ) / uint32_t(vp_13l >> nv));
+            k = y30 < 0 ? -k : k;
+            int32_t shift = ny + nv - 2;
+
+            int32_t x23 = ( ( up_13l >> 4 ) * 9 ) >> 2;
+            int32_t z23 = ( l * 39 * 256 ) - ( ( ( up_13l >> 4 ) * 3 ) >> 2 ) - ( ( vp_13l >> 4 ) * 5 );
+
+            x28 = to_q28(int64_t(k) * x23, shift);
+            z28 = to_q28(int64_t(k) * z23, shift);
+        }
+        int32_t y28 = y30 >> 2;
+
+        out[c].r = to_ws2816(int64_t(m[0][0]) * x28 + int64_t(m[0][1]) * y28 + int64_t(m[0][2]) * z28);
+        out[c].g = to_ws2816(int64_t(m[1][0]) * x28 + int64_t(m[1][1]) * y28 + int64_t(m[1][2]) * z28);
+        out[c].b = to_ws2816(int64_t(m[2][0]) * x28 + int64_t(m[2][1]) * y28 + int64_t(m[2][2]) * z28);
+        out[c].a = 0;
+    }
+}
+
 }
@@ -28,6 +28,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <cmath>
 #include <cfloat>
 #include <array>
+#include <span>
 
 #include "./vector.h"
 #include "./fastmath.h"
@@ -128,38 +129,73 @@ namespace color {
         return uint16_t(__builtin_arm_usat(int32_t(v * 65535.f), 16));
     }
 
+    // Piecewise linear in the stops, evaluated directly. Same result as sampling the stops densely
+    // for a fraction of the memory, and rebuilding is a copy of the stops.
     class gradient {
     public:
-        template<class T, std::size_t N> constexpr gradient(const T (&stops)[N]) {
-            for (size_t c = 0; c < colors_n; c++) {
-                float f = static_cast<float>(c) / static_cast<float>(colors_n - 1);
-                vector::float4 a = stops[0];
-                vector::float4 b = stops[1];
-                if (N > 2) {
-                    for (int32_t d = static_cast<int32_t>(N-2); d >= 0 ; d--) {
-                        if ( f >= (stops[d].w) ) {
-                            a = stops[d+0];
-                            b = stops[d+1];
-                            break;
-                        }
-                    }
-                }
-                f -= a.w;
-                f /= b.w - a.w;
-                colors[c] = a.lerp(b,f);
+        template<class T, std::size_t N> constexpr gradient(const T (&_stops)[N]) {
+            static_assert(N >= 2 && N <= stops_max, "Gradient needs 2 to stops_max stops.");
+            stops_n = N;
+            for (size_t c = 0; c < N; c++) {
+                stops[c] = _stops[c];
+            }
+            for (size_t c = 0; c < N - 1; c++) {
+                float d = stops[c+1].w - stops[c].w;
+                stops_rcp[c] = ( d != 0.0f ) ? ( 1.0f / d ) : 0.0f;
             }
         }
+        // Flat black
+        gradient() = default;
+        // Stops built at runtime, w is the position. Extra stops past stops_max are dropped,
+        // fewer than 2 give a flat gradient of the one stop or black.
+        explicit gradient(std::span<const vector::float4> _stops);
 
         vector::float4 repeat(float i) const;
         vector::float4 reflect(float i) const;
         vector::float4 clamp(float i) const;
 
+        // out[c] = repeat(phase + step * c). Phase runs in Q32 so it wraps for free,
+        // unlike repeat(float) negative positions wrap instead of mirroring.
+        void repeat(std::span<vector::float4> out, float phase, float step) const;
+        // out[c] = reflect(phase + step * c), phase runs in Q32 over the period of 2
+        void reflect(std::span<vector::float4> out, float phase, float step) const;
+        // out[c] = clamp(in[c])
+        void clamp(std::span<vector::float4> out, std::span<const float> in) const;
+
+        static constexpr size_t stops_max = 8;
+
     private:
-        static constexpr size_t colors_n = 256;
-        static constexpr float colors_mul = 255.0;
-        static constexpr size_t colors_mask = 0xFF;
+        vector::float4 sample(float i) const;
 
-        vector::float4 colors[colors_n];
+        // Always at least 2, sample() relies on it
+        size_t stops_n = 2;
+        vector::float4 stops[stops_max];
+        float stops_rcp[stops_max] = { };
+    };
+
+    // Lightness transfer of one brightness level for convert::OKLAB2WS2816, Y = f(brightness * L) in Q30.
+    class led_transfer {
+    public:
+        void set(float brightness);
+
+        int32_t y30(int32_t l) const {
+            uint32_t a = uint32_t(__builtin_arm_usat(l < 0 ? -l : l, 15));
+            uint32_t i = a >> lut_shift;
+            int32_t f = int32_t(a & lut_mask);
+            int32_t y = lut[i] + ( ( ( lut[i + 1] - lut[i] ) * f ) >> lut_shift );
+            return l < 0 ? -y : y;
+        }
+
+        int32_t vp_min() const { return vp_min_13l; }
+
+    private:
+        static constexpr size_t lut_n = 256;
+        static constexpr uint32_t lut_shift = 7;
+        static constexpr uint32_t lut_mask = 0x7F;
+
+        float brightness = -1.0f;
+        int32_t vp_min_13l = 0;
+        std::array<int32_t, lut_n + 1> lut = { };
     };
 
     class convert {
@@ -223,6 +259,9 @@ namespace color {
         vector::float4 OKLAB2sRGB(const vector::float4 &) const;
         vector::float4 OKLAB2LED(const vector::float4 &) const;
 
+        // Batched fixed point version of OKLAB2LED(in * brightness).clamp() followed by fix_for_ws2816()
+        void OKLAB2WS2816(const vector::float4 *in, rgba<uint16_t> *out, size_t n, const led_transfer &transfer) const;
+
     private:
         float sRGB2lRGB[256];
     };
@@ -356,20 +395,67 @@ namespace color {
         return vector::float4(lRGB2OKLAB(vector::float4(r,g,b,hsv.w)));
     }
 
+    // hsv(h, 1, 1) sampled at compile time, linear interpolation in between
+    class hue_wheel {
+    public:
+        consteval hue_wheel() : table() {
+            for (size_t c = 0; c <= table_n; c++) {
+                table[c] = hsv(vector::float4(float(c) / float(table_n), 1.0f, 1.0f, 0.0f));
+            }
+        }
+
+        vector::float4 operator()(float h) const {
+            h -= floorf(h);
+            h *= float(table_n);
+            size_t i = std::min(static_cast<size_t>(h), table_n - 1);
+            return vector::float4::lerp(table[i], table[i+1], h - float(i));
+        }
+
+    private:
+        static constexpr size_t table_n = 1024;
+        vector::float4 table[table_n + 1];
+    };
+
+    inline constexpr hue_wheel hue_wheel_lut;
+
+    // Same as hsv({h, 1, 1}), wraps outside of [0, 1)
+    inline vector::float4 hue(float h) {
+        return hue_wheel_lut(h);
+    }
+
+    // OKLCh, hue from the wheel, c scales the chroma of the fully saturated hue, l is the OKLab lightness
+    inline vector::float4 oklch(float h, float c, float l) {
+        vector::float4 w(hue_wheel_lut(h));
+        return vector::float4(l, w.y * c, w.z * c);
+    }
+
     constexpr vector::float4 srgb(const vector::float4 &color, float alpha = 1.0f) {
         return vector::float4(sRGB2OKLAB(color), alpha);
     }
 
+    // Built at compile time, shared by all sRGB8 conversions
+    inline constexpr convert srgb8_convert;
+
+    // Runtime sRGB8 to OKLAB through a small memo cache, model colors repeat every frame.
+    // Colors that change per LED go through srgb8_convert directly, they would only evict them.
+    vector::float4 srgb8_cached(const rgba<uint8_t> &color);
+
     constexpr vector::float4 srgb8(const rgba<uint8_t> &color, float alpha = 1.0f) {
-        return vector::float4(convert().sRGB2OKLAB(color), alpha);
+        if (std::is_constant_evaluated()) {
+            return vector::float4(srgb8_convert.sRGB2OKLAB(color), alpha);
+        }
+        return vector::float4(srgb8_cached(color), alpha);
     }
 
     constexpr vector::float4 srgb8_stop(const rgba<uint8_t> &color, float stop) {
-        return vector::float4(convert().sRGB2OKLAB(color), stop);
+        if (std::is_constant_evaluated()) {
+            return vector::float4(srgb8_convert.sRGB2OKLAB(color), stop);
+        }
+        return vector::float4(srgb8_cached(color), stop);
     }
 
     constexpr vector::float4 srgb8_stop(uint32_t color, float stop) {
-        return vector::float4(convert().sRGB2OKLAB(rgba<uint8_t>(color)), stop);
+        return srgb8_stop(rgba<uint8_t>(color), stop);
     }
 }
 
@@ -0,0 +1,83 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./compositor.h"
+
+#include <stdio.h>
+
+Compositor &Compositor::instance() {
+    static Compositor compositor;
+    if (!compositor.initialized) {
+        compositor.initialized = true;
+        compositor.init();
+    }
+    return compositor;
+}
+
+void Compositor::init() {
+    printf("Compositor initialized.\n");
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void Compositor::blend(std::span<vector::float4> dst, std::span<const vector::float4> src, float alpha, BlendMode mode) {
+    size_t n = std::min(src.size(), dst.size());
+    switch (mode) {
+        case Normal: {
+            // Q15, each SMUAD weights one channel of dst and src together
+            const uint32_t w = vector::q15x4::lerp_weight(alpha);
+            for (size_t c = 0; c < n; c++) {
+                dst[c] = vector::q15x4::lerp(vector::q15x4(dst[c]), vector::q15x4(src[c]), w).to_float4();
+            }
+        } break;
+        case Add: {
+            // Q15, saturates at 1 instead of pushing lightness past what the LEDs show
+            const uint32_t w = vector::q15x4::scale_weight(alpha);
+            for (size_t c = 0; c < n; c++) {
+                dst[c] = vector::q15x4::add(vector::q15x4(dst[c]), vector::q15x4::scale(vector::q15x4(src[c]), w)).to_float4();
+            }
+        } break;
+        case Lighten: {
+            for (size_t c = 0; c < n; c++) {
+                if (src[c].x > dst[c].x) {
+                    dst[c] = vector::float4::lerp(dst[c], src[c], alpha);
+                }
+            }
+        } break;
+    }
+}
+
+void Compositor::composite() {
+    Leds::Frame &output(Leds::instance().getOutput());
+    for (Layer &l : layers) {
+        if (!l.active) {
+            continue;
+        }
+        l.active = false;
+        if (l.alpha <= 0.0f) {
+            continue;
+        }
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            blend(output.circle[s], l.frame.circle[s], l.alpha, l.mode);
+            blend(output.bird[s], l.frame.bird[s], l.alpha, l.mode);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_
+
+#include "./leds.h"
+
+#include <array>
+#include <span>
+#include <cassert>
+
+// Overlay layers blended in place onto the LED output. The base layer is the output framebuffer
+// itself, so a single effect costs nothing extra and N effects cost N-1 blend passes.
+class Compositor {
+public:
+    // Only the cross-fade uses a layer so far, each one is a full float4 frame of SRAM
+    static constexpr size_t layersN = 1;
+
+    enum BlendMode {
+        Normal,     // lerp(dst, src, alpha)
+        Add,        // dst + src * alpha
+        Lighten     // lerp(dst, src, alpha) where src is lighter
+    };
+
+    struct Layer {
+        Leds::Frame frame;
+        float alpha = 1.0f;
+        BlendMode mode = Normal;
+        bool active = false;
+    };
+
+    static Compositor &instance();
+
+    // Runs func with all LED writes going into layer index
+    template<class F> void render(size_t index, const F &func) {
+        assert(index < layersN);
+        Layer &l(layers[index]);
+        Leds::instance().setTarget(&l.frame);
+        func();
+        Leds::instance().setTarget(nullptr);
+        l.active = true;
+    }
+
+    Layer &layer(size_t index) { assert(index < layersN); return layers[index]; }
+
+    // Blends all active layers onto the output in index order and deactivates them
+    void composite();
+
+    static void blend(std::span<vector::float4> dst, std::span<const vector::float4> src, float alpha, BlendMode mode);
+
+private:
+    std::array<Layer, layersN> layers;
+
+    void init();
+    bool initialized = false;
+};
+
+#endif /* COMPOSITOR_H_ */
@@ -27,11 +27,15 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./color.h"
 #include "./fastmath.h"
 #include "./seed.h"
-#include "./mmc5633njl.h"
+#include "./motion.h"
+#include "./profiler.h"
+#include "./compositor.h"
+#include "./vm.h"
 
 #include <random>
 #include <array>
 #include <limits>
+#include <numbers>
 #include <math.h>
 
 static constexpr color::gradient gradient_rainbow({
@@ -44,6 +48,28 @@ static constexpr color::gradient gradient_rainbow({
     color::srgb8_stop({0xff,0x00,0x00}, 1.00f)
 });
 
+// Effect kernels, func is a template parameter so the per LED body is inlined into the loop
+
+// Ring side 0 from func(pos, index), side 1 mirrored
+template<class F> static void ring_mirrored(const F &func) {
+    Leds &leds(Leds::instance());
+    auto ring = leds.circle(0);
+    for (size_t c = 0; c < Leds::circleLedsN; c++) {
+        ring[c] = func(Leds::map.getCircle(0, c), c);
+    }
+    Leds::copyMirrored(leds.circle(1), ring);
+}
+
+// Birds on both sides from func(pos, index), each side with its own positions
+template<class F> static void birds(const F &func) {
+    Leds &leds(Leds::instance());
+    for (size_t c = 0; c < Leds::birdLedsN; c++) {
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            leds.bird(s)[c] = func(Leds::map.getBird(s, c), c);
+        }
+    }
+}
+
 Effects &Effects::instance() {
     static Effects effects;
     if (!effects.initialized) {
@@ -54,39 +80,20 @@ Effects &Effects::instance() {
 }
 
 void Effects::black() {
-    auto calc = [](const std::function<vector::float4 ()> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto col = func();
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, c, col);
-        }
-        for (size_t c = 0; c < Leds::birdLedsN; c++) {
-            auto col = func();
-            leds.setBird(0, c, col);
-            leds.setBird(1, c, col);
-        }
-    };
-    calc([=]() {
-        return vector::float4();
-    });
+    Leds &leds(Leds::instance());
+    for (size_t s = 0; s < Leds::sidesN; s++) {
+        Leds::fill(leds.circle(s), vector::float4());
+        Leds::fill(leds.bird(s), vector::float4());
+    }
 }
 
 void Effects::standard_bird() {
     vector::float4 bird(color::srgb8(Model::instance().BirdColor()));
 
-    auto calc = [](const std::function<vector::float4 ()> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::birdLedsN; c++) {
-            auto col = func();
-            leds.setBird(0,c,col);
-            leds.setBird(1,c,col);
-        }
-    };
-
-    calc([=]() {
-        return bird;
-    });
+    Leds &leds(Leds::instance());
+    for (size_t s = 0; s < Leds::sidesN; s++) {
+        Leds::fill(leds.bird(s), bird);
+    }
 }
 
 void Effects::color_walker() {
@@ -99,19 +106,9 @@ void Effects::color_walker() {
     float rgb_walk = (       static_cast<float>(frac(now * (1.0 / 5.0) * speed)));
     float val_walk = (1.0f - static_cast<float>(frac(now               * speed)));
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos, float walk)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            float mod_walk = fracf(val_walk + (1.0f - (float(c) * ( fast_rcp(static_cast<float>(Leds::circleLedsN))))));
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos, mod_walk);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
     vector::float4 col(gradient_rainbow.repeat(rgb_walk));
-    calc([=](const vector::float4 &pos, float walk) {
+    ring_mirrored([=](const vector::float4 &pos, size_t index) {
+        float walk = fracf(val_walk + (1.0f - (float(index) * ( fast_rcp(static_cast<float>(Leds::circleLedsN))))));
         float v = fast_pow(std::min(1.0f, walk), 2.0f);;
         return col * v;
     });
@@ -128,17 +125,8 @@ void Effects::light_walker() {
     float rgb_walk = (       static_cast<float>(frac(now * (1.0 / 5.0) * speed)));
     float val_walk = (1.0f - static_cast<float>(frac(now               * speed)));
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos, float walk)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            float mod_walk = fracf(val_walk + (1.0f - (float(c) * ( fast_rcp(static_cast<float>(Leds::circleLedsN))))));
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos, mod_walk);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-    calc([=](const vector::float4 &pos, float walk) {
+    ring_mirrored([=](const vector::float4 &pos, size_t index) {
+        float walk = fracf(val_walk + (1.0f - (float(index) * ( fast_rcp(static_cast<float>(Leds::circleLedsN))))));
         return color::hsv({rgb_walk, 1.0f - fast_pow(std::min(1.0f, walk), 6.0f), fast_pow(std::min(1.0f, walk), 6.0f)});
     });
 }
@@ -228,9 +216,9 @@ void Effects::rgb_band() {
     Leds &leds(Leds::instance());
     for (size_t c = 0; c < Leds::circleLedsN; c++) {
         auto out = color::srgb({band_r[c], band_g[c], band_b[c]});
-        leds.setCircle(0, c, out);
-        leds.setCircle(1, Leds::circleLedsN-1-c, out);
+        leds.circle(0)[c] = out;
     }
+    Leds::copyMirrored(leds.circle(1), leds.circle(0));
 
     rgb_band_r_walk -= rgb_band_r_walk_step;
     rgb_band_g_walk += rgb_band_g_walk_step;
@@ -240,20 +228,8 @@ void Effects::rgb_band() {
 void Effects::direction() {
     standard_bird();
 
-    MMC5633NJL::instance().update();
-
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    vector::float4 col(gradient_rainbow.repeat((MMC5633NJL::instance().Z()+400.0f) * (1.0f/700.0f)));
-    calc([=](const vector::float4 &pos) {
+    vector::float4 col(gradient_rainbow.repeat(Motion::instance().Yaw() * (0.5f / float(std::numbers::pi)) + 0.5f));
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         return col;
     });
 
@@ -262,17 +238,7 @@ void Effects::direction() {
 void Effects::static_color() {
     standard_bird();
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &) {
+    ring_mirrored([=](const vector::float4 &, size_t) {
         return vector::float4(color::srgb8(Model::instance().RingColor()));
     });
 }
@@ -280,22 +246,12 @@ void Effects::static_color() {
 void Effects::rgb_glow() {
     standard_bird();
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
     double now = Timeline::SystemTime();
     const double speed = 0.5;
     float rgb_walk = (static_cast<float>(fmodf(static_cast<float>(now * (1.0 / 5.0) * speed), 1.0)));
 
-    vector::float4 out = color::hsv({rgb_walk, 1.0f, 1.0f});        
-    calc([=](const vector::float4 &) {
+    vector::float4 out = color::hue(rgb_walk);        
+    ring_mirrored([=](const vector::float4 &, size_t) {
         return out;
     });
 }
@@ -303,17 +259,7 @@ void Effects::rgb_glow() {
 void Effects::lightning() {
     standard_bird();
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &) {
+    ring_mirrored([=](const vector::float4 &, size_t) {
         return color::srgb({0,0,0,0});
     });
 
@@ -329,17 +275,7 @@ void Effects::lightning() {
 void Effects::lightning_crazy() {
     standard_bird();
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &) {
+    ring_mirrored([=](const vector::float4 &, size_t) {
         return color::srgb({0,0,0,0});
     });
 
@@ -356,17 +292,7 @@ void Effects::sparkle() {
 
     standard_bird();
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &) {
+    ring_mirrored([=](const vector::float4 &, size_t) {
         return vector::float4(0,0,0,0);
     });
 
@@ -388,17 +314,7 @@ void Effects::sparkle() {
 void Effects::rando() {
     standard_bird();
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([this](const vector::float4 &) {
+    ring_mirrored([this](const vector::float4 &, size_t) {
         return vector::float4(
             color::srgb({random.get(0.0f,1.0f),
                          random.get(0.0f,1.0f),
@@ -412,17 +328,7 @@ void Effects::red_green() {
 
     float now = float(Timeline::SystemTime());
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         return color::srgb({pos.x * sinf(now), pos.y * cosf(now), 0, 0});
     });
 }
@@ -457,17 +363,7 @@ void Effects::brilliance() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         auto p = pos.rotate2d(dir);
         p *= 0.50f;
         p += (next - now) * 8.0f;
@@ -505,17 +401,7 @@ void Effects::highlight() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         auto p = pos.rotate2d(dir);
         p *= 0.50f;
         p += (next - now);
@@ -539,17 +425,7 @@ void Effects::autumn() {
         color::srgb8_stop(0x968b3f, 1.00f)
     });
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         auto p = pos + 0.5f;
         p = p.rotate2d(now);
         p *= 0.5f;
@@ -578,17 +454,7 @@ void Effects::heartbeat() {
             color::srgb8_stop(Model::instance().RingColor(), 1.00)});
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         return g.reflect(now);
     });
 }
@@ -598,17 +464,7 @@ void Effects::moving_rainbow() {
 
     float now = float(Timeline::SystemTime());
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         auto p = pos.rotate2d(-now * 0.25f);
         p += now;
         p *= 0.25f;
@@ -656,17 +512,7 @@ void Effects::twinkle() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos, size_t index)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos, c);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos, size_t index) {
+    ring_mirrored([=](const vector::float4 &pos, size_t index) {
         for (size_t c = 0; c < many; c++) {
             if (which[c] == index) {
                 return (g.clamp(next[c] - now));
@@ -707,19 +553,9 @@ void Effects::twinkly() {
         }
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos, size_t index)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos, c);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
     vector::float4 ring(color::srgb8(Model::instance().RingColor()));
 
-    calc([=](const vector::float4 &pos, size_t index) {
+    ring_mirrored([=](const vector::float4 &pos, size_t index) {
         for (size_t c = 0; c < many; c++) {
             if (which[c] == index) {
                 return g.clamp(next[c] - now) + ring;
@@ -749,17 +585,7 @@ void Effects::randomfader() {
             random.get(0.0f,1.0f)});
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         float dist = pos.dist(Leds::instance().map.getCircle(0, which)) * (next - now);
         if (dist > 1.0f) dist = 1.0f;
         return vector::float4::lerp(color, prev_color, dist);
@@ -788,17 +614,7 @@ void Effects::brightchaser() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         auto p = pos.rotate2d(now);
         return g.clamp(p.x);
     });
@@ -809,41 +625,21 @@ void Effects::chaser() {
 
     float now = float(Timeline::SystemTime());
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
     vector::float4 ring(Model::instance().RingColor());
 
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         auto p = pos.rotate2d(now);
-        return color::srgb8((ring * p.x).clamp());
+        return vector::float4(color::srgb8_convert.sRGB2OKLAB((ring * p.x).clamp()), 1.0f);
     });
 }
 
 void Effects::gradient() {
     standard_bird();
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
     vector::float4 ring(Model::instance().RingColor());
 
-    calc([=](const vector::float4 &pos) {
-        return color::srgb8((ring * (1.0f - ( (pos.y + 1.0f) * 0.50f ) )).clamp());
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
+        return vector::float4(color::srgb8_convert.sRGB2OKLAB((ring * (1.0f - ( (pos.y + 1.0f) * 0.50f ) )).clamp()), 1.0f);
     });
 }
 
@@ -868,29 +664,13 @@ void Effects::overdrive() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-        for (size_t c = 0; c < Leds::birdLedsN; c++) {
-            auto pos = Leds::instance().map.getBird(0, c);
-            auto col = func(pos);
-            leds.setBird(0, c, col);
-            pos = Leds::instance().map.getBird(1, c);
-            col = func(pos);
-            leds.setBird(1, c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    auto kernel = [=](const vector::float4 &pos, size_t) {
         float x = sinf(pos.x + 1.0f + now * 1.77f);
         float y = cosf(pos.y + 1.0f + now * 2.01f);
         return (g.reflect(x * y));
-    });
+    };
+    ring_mirrored(kernel);
+    birds(kernel);
 }
 
 void Effects::ironman() {
@@ -915,28 +695,12 @@ void Effects::ironman() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-        for (size_t c = 0; c < Leds::birdLedsN; c++) {
-            auto pos = Leds::instance().map.getBird(0,c);
-            auto col = func(pos);
-            leds.setBird(0, c, col);
-            pos = Leds::instance().map.getBird(1,c);
-            col = func(pos);
-            leds.setBird(1, c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    auto kernel = [=](const vector::float4 &pos, size_t) {
         float len = pos.xy00().len();
         return g.clamp(1.0f-((len!=0.0f)?1.0f/len:1000.0f)*(fabsf(sinf(now))));
-    });
+    };
+    ring_mirrored(kernel);
+    birds(kernel);
 }
 
 void Effects::sweep() {
@@ -960,17 +724,7 @@ void Effects::sweep() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         return g.reflect(pos.rotate2d(-now * 0.5f).y - now * 8.0f);
     });
 }
@@ -997,17 +751,7 @@ void Effects::sweephighlight() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         return g.reflect(pos.rotate2d(-now * 0.25f).y - now * 2.0f);
     });
 }
@@ -1017,18 +761,8 @@ void Effects::rainbow_circle() {
 
     float now = float(Timeline::SystemTime());
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
-        return color::hsv({fmodf((atan2f(pos.x, pos.y) + 3.14159f) / (3.14159f * 2.0f) + now * 0.5f, 1.0f), 1.0f, 1.0f});
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
+        return color::hue((atan2f(pos.x, pos.y) + 3.14159f) / (3.14159f * 2.0f) + now * 0.5f);
     });
 }
 
@@ -1037,18 +771,8 @@ void Effects::rainbow_grow() {
 
     float now = float(Timeline::SystemTime());
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
-        return color::hsv({fmodf(fabsf(pos.x * 0.25f + signf(pos.x) * now * 0.25f), 1.0f), 1.0f, 1.0f});
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
+        return color::hue(fabsf(pos.x * 0.25f + signf(pos.x) * now * 0.25f));
     });
 }
 
@@ -1074,19 +798,10 @@ void Effects::rotor() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
-        return g.repeat(fmodf((atan2f(pos.x, pos.y) + 3.14159f) / (3.14159f * 2.0f) + now * 0.5f, 1.0f) * 4.0f);
-    });
+    // Ring LED c sits at angle c / circleLedsN
+    Leds &leds(Leds::instance());
+    g.repeat(leds.circle(0), now * 0.5f * 4.0f, 4.0f / float(Leds::circleLedsN));
+    Leds::copyMirrored(leds.circle(1), leds.circle(0));
 }
 
 void Effects::rotor_sparse() {
@@ -1112,19 +827,10 @@ void Effects::rotor_sparse() {
         });
     }
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc([=](const vector::float4 &pos) {
-        return g.repeat(fmodf((atan2f(pos.x, pos.y) + 3.14159f) / (3.14159f * 2.0f) + now * 0.5f, 1.0f) * 3.0f);
-    });
+    // Ring LED c sits at angle c / circleLedsN
+    Leds &leds(Leds::instance());
+    g.repeat(leds.circle(0), now * 0.5f * 3.0f, 3.0f / float(Leds::circleLedsN));
+    Leds::copyMirrored(leds.circle(1), leds.circle(0));
 }
 
 void Effects::fullcolor() {
@@ -1138,23 +844,19 @@ void Effects::fullcolor() {
         color::srgb8_stop(0x000000, 1.00f),
     });
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
+    // Ring LED c sits at angle c / circleLedsN
+    std::array<vector::float4, Leds::circleLedsN> r;
+    std::array<vector::float4, Leds::circleLedsN> gr;
+    std::array<vector::float4, Leds::circleLedsN> b;
+    g.repeat(r, now * 0.50f, 1.0f / float(Leds::circleLedsN));
+    g.repeat(gr, now * 0.75f, 1.0f / float(Leds::circleLedsN));
+    g.repeat(b, now * 0.33f, 1.0f / float(Leds::circleLedsN));
 
-    calc([=](const vector::float4 &pos) {
-        return color::srgb(vector::float4(
-            g.repeat(fmodf((atan2f(pos.x, pos.y) + 3.14159f) / (3.14159f * 2.0f) + now * 0.50f, 1.0f)).x,
-            g.repeat(fmodf((atan2f(pos.x, pos.y) + 3.14159f) / (3.14159f * 2.0f) + now * 0.75f, 1.0f)).x,
-            g.repeat(fmodf((atan2f(pos.x, pos.y) + 3.14159f) / (3.14159f * 2.0f) + now * 0.33f, 1.0f)).x
-        ));
-    });
+    Leds &leds(Leds::instance());
+    for (size_t c = 0; c < Leds::circleLedsN; c++) {
+        leds.circle(0)[c] = color::srgb(vector::float4(r[c].x, gr[c].x, b[c].x));
+    }
+    Leds::copyMirrored(leds.circle(1), leds.circle(0));
 }
 
 void Effects::flip_colors() {
@@ -1165,37 +867,130 @@ void Effects::flip_colors() {
     vector::float4 bird(color::srgb8(Model::instance().BirdColor()));
     vector::float4 ring(color::srgb8(Model::instance().RingColor()));
 
-    auto calc_inner = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::birdLedsN; c++) {
-            auto pos = Leds::instance().map.getBird(0,c);
-            auto col = func(pos);
-            leds.setBird(0, c, col);
-            pos = Leds::instance().map.getBird(1,c);
-            col = func(pos);
-            leds.setBird(1, c, col);
-        }
-    };
-
-    auto calc_outer = [=](const std::function<vector::float4 (const vector::float4 &pos)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            auto pos = Leds::instance().map.getCircle(0, c);
-            auto col = func(pos);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-
-    calc_inner([=](const vector::float4 &pos) {
+    birds([=](const vector::float4 &pos, size_t) {
         return vector::float4::lerp(bird, ring, (sinf(now) + 1.0f) * 0.5f);
     });
 
-    calc_outer([=](const vector::float4 &pos) {
+    ring_mirrored([=](const vector::float4 &pos, size_t) {
         return vector::float4::lerp(ring, bird, (sinf(now) + 1.0f) * 0.5f);
     });
 }
 
+void Effects::release(uint32_t effect) {
+    if (effect >= Model::builtinEffectCount) {
+        VM::instance().release(effect - Model::builtinEffectCount);
+    }
+}
+
+void Effects::calc(uint32_t effect) {
+    switch (effect) {
+        case 0:
+            black();
+        break;
+        case 1:
+            static_color();
+        break;
+        case 2:
+            rgb_band();
+        break;
+        case 3:
+            color_walker();
+        break;
+        case 4:
+            light_walker();
+        break;
+        case 5:
+            rgb_glow();
+        break;
+        case 6:
+            lightning();
+        break;
+        case 7:
+            lightning_crazy();
+        break;
+        case 8:
+            sparkle();
+        break;
+        case 9:
+            rando();
+        break;
+        case 10:
+            red_green();
+        break;
+        case 11:
+            brilliance();
+        break;
+        case 12:
+            highlight();
+        break;
+        case 13:
+            autumn();
+        break;
+        case 14:
+            heartbeat();
+        break;
+        case 15:
+            moving_rainbow();
+        break;
+        case 16:
+            twinkle();
+        break;
+        case 17:
+            twinkly();
+        break;
+        case 18:
+            randomfader();
+        break;
+        case 19:
+            chaser();
+        break;
+        case 20:
+            brightchaser();
+        break;
+        case 21:
+            gradient();
+        break;
+        case 22:
+            overdrive();
+        break;
+        case 23:
+            ironman();
+        break;
+        case 24:
+            sweep();
+        break;
+        case 25:
+            sweephighlight();
+        break;
+        case 26:
+            rainbow_circle();
+        break;
+        case 27:
+            rainbow_grow();
+        break;
+        case 28:
+            rotor();
+        break;
+        case 29:
+            rotor_sparse();
+        break;
+        case 30:
+            fullcolor();
+        break;
+        case 31:
+            flip_colors();
+        break;
+        case 32:
+            direction();
+        break;
+        default:
+            if (effect >= Model::builtinEffectCount) {
+                VM::instance().calc(effect - Model::builtinEffectCount);
+            }
+        break;
+    }
+}
+
 void Effects::init() {
 
     random.set_seed(Seed::instance().seedU32());
@@ -1206,161 +1001,53 @@ void Effects::init() {
         mainEffect.time = Timeline::SystemTime();
         mainEffect.duration = std::numeric_limits<double>::infinity();
         mainEffect.calcFunc = [this](Timeline::Span &, Timeline::Span &) {
+            Profiler::Scope profile(Profiler::Calc);
 
             static uint32_t current_effect = 0;
             static uint32_t previous_effect = 0;
             static double switch_time = 0;
 
             if ( current_effect != Model::instance().Effect() ) {
+                uint32_t next_effect = Model::instance().Effect();
+                // Switching again mid-fade drops the effect that was still fading out
+                if (previous_effect != current_effect && previous_effect != next_effect) {
+                    release(previous_effect);
+                }
                 previous_effect = current_effect;
-                current_effect = Model::instance().Effect();
+                current_effect = next_effect;
                 switch_time = Timeline::SystemTime();
             }
-
-            auto calc_effect = [this] (uint32_t effect) {
-                switch (effect) {
-                    case 0:
-                        black();
-                    break;
-                    case 1:
-                        static_color();
-                    break;
-                    case 2:
-                        rgb_band();
-                    break;
-                    case 3:
-                        color_walker();
-                    break;
-                    case 4:
-                        light_walker();
-                    break;
-                    case 5:
-                        rgb_glow();
-                    break;
-                    case 6:
-                        lightning();
-                    break;
-                    case 7:
-                        lightning_crazy();
-                    break;
-                    case 8:
-                        sparkle();
-                    break;
-                    case 9:
-                        rando();
-                    break;
-                    case 10:
-                        red_green();
-                    break;
-                    case 11:
-                        brilliance();
-                    break;
-                    case 12:
-                        highlight();
-                    break;
-                    case 13:
-                        autumn();
-                    break;
-                    case 14:
-                        heartbeat();
-                    break;
-                    case 15:
-                        moving_rainbow();
-                    break;
-                    case 16:
-                        twinkle();
-                    break;
-                    case 17:
-                        twinkly();
-                    break;
-                    case 18:
-                        randomfader();
-                    break;
-                    case 19:
-                        chaser();
-                    break;
-                    case 20:
-                        brightchaser();
-                    break;
-                    case 21:
-                        gradient();
-                    break;
-                    case 22:
-                        overdrive();
-                    break;
-                    case 23:
-                        ironman();
-                    break;
-                    case 24:
-                        sweep();
-                    break;
-                    case 25:
-                        sweephighlight();
-                    break;
-                    case 26:
-                        rainbow_circle();
-                    break;
-                    case 27:
-                        rainbow_grow();
-                    break;
-                    case 28:
-                        rotor();
-                    break;
-                    case 29:
-                        rotor_sparse();
-                    break;
-                    case 30:
-                        fullcolor();
-                    break;
-                    case 31:
-                        flip_colors();
-                    break;
-                    case 32:
-                        direction();
-                    break;
-                }
-            };
+            Profiler::instance().setEffect(current_effect);
 
             double blend_duration = 0.5;
             double now = Timeline::SystemTime();
 
-            Leds &leds(Leds::instance());
-
             if ((now - switch_time) < blend_duration) {
-                calc_effect(previous_effect);
+                // Current effect renders straight into the output, the previous one fades out on top
+                Compositor &compositor(Compositor::instance());
+                compositor.render(0, [&] {
+                    calc(previous_effect);
+                });
 
-                auto circleLedsPrev = leds.getCircle();
-                auto birdsLedsPrev = leds.getBird();
-
-                calc_effect(current_effect);
-
-                auto circleLedsNext = leds.getCircle();
-                auto birdsLedsNext = leds.getBird();
+                calc(current_effect);
 
                 float blend = static_cast<float>(now - switch_time) * (fast_rcp(static_cast<float>(blend_duration)));
 
-                for (size_t c = 0; c < circleLedsNext.size(); c++) {
-                    for (size_t d = 0; d < circleLedsNext[c].size(); d++) {
-                        circleLedsNext[c][d] = vector::float4::lerp(circleLedsPrev[c][d], circleLedsNext[c][d], blend);
-                    }
-                }
-
-                leds.setCircle(circleLedsNext);
-
-                for (size_t c = 0; c < birdsLedsNext.size(); c++) {
-                    for (size_t d = 0; d < birdsLedsNext[c].size(); d++) {
-                        birdsLedsNext[c][d] = vector::float4::lerp(birdsLedsPrev[c][d], birdsLedsNext[c][d], blend);
-                    }
-                }
-
-                leds.setBird(birdsLedsNext);
-
+                compositor.layer(0).alpha = 1.0f - blend;
+                compositor.layer(0).mode = Compositor::Normal;
+                compositor.composite();
             } else {
-                calc_effect(current_effect);
+                if (previous_effect != current_effect) {
+                    // Cross-fade is over, nothing renders the previous effect any more
+                    release(previous_effect);
+                    previous_effect = current_effect;
+                }
+                calc(current_effect);
             }
 
         };
         mainEffect.commitFunc = [this](Timeline::Span &) {
+            Profiler::Scope profile(Profiler::Commit);
             Leds::instance().apply();
         };
         Timeline::instance().Add(mainEffect);
@@ -29,6 +29,12 @@ class Effects {
 public:
     static Effects &instance();
 
+    // One frame of an effect into Leds, the main effect span calls this every tick
+    void calc(uint32_t effect);
+    void seed(uint32_t seed) { random.set_seed(seed); }
+    // Effect is no longer rendered, after its cross-fade out
+    void release(uint32_t effect);
+
 private:
 
     class pseudo_random {
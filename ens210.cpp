@@ -25,18 +25,6 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdio.h>
 
-static void delay_us(int usec) {
-    asm volatile (
-        "1:\n\t"
-#define NOP6 "nop\n\tnop\n\tnop\n\tnop\n\tnop\n\tnop\n\t"
-#define NOP24 NOP6 NOP6 NOP6 NOP6
-#define NOP96 NOP24 NOP24 NOP24 NOP24
-        NOP96
-        "subs %[usec], #1\n\t"
-        "bge 1b\n\t"
-    : : [usec] "r" (usec) : );
-}
-
 bool ENS210::devicePresent = false;
 
 ENS210 &ENS210::instance() {
@@ -48,14 +36,58 @@ ENS210 &ENS210::instance() {
     return ens210;
 }
 
+void ENS210::schedule(State next, double delay) {
+    // Picked up by doneFunc once the current event retires
+    nextState = next;
+    nextDelay = delay;
+    if (!Timeline::instance().Scheduled(stepEvent)) {
+        state = next;
+        stepEvent.time = Timeline::SystemTime() + delay;
+        Timeline::instance().Add(stepEvent);
+    }
+}
+
+void ENS210::step() {
+    switch (state) {
+        case Idle: {
+        } break;
+        case Reset: {
+            reset();
+            schedule(Normal, resetTime);
+        } break;
+        case Normal: {
+            normal();
+            schedule(Measure, resetTime);
+        } break;
+        case Measure: {
+            measure();
+            schedule(Read, conversionTime);
+        } break;
+        case Read: {
+            if (busy()) {
+                schedule(Read, pollTime);
+                break;
+            }
+            read();
+            nextState = Idle;
+            if (!reported) {
+                reported = true;
+                stats();
+            }
+        } break;
+    }
+}
+
 void ENS210::reset() {
     if (!devicePresent) return;
     static uint8_t th_reset[] = { 0x10, 0x80 };
     i2c1::instance().write(i2c_addr, th_reset, 2);
-    delay_us(2000);
+}
+
+void ENS210::normal() {
+    if (!devicePresent) return;
     static uint8_t th_normal[] = { 0x10, 0x00 };
     i2c1::instance().write(i2c_addr, th_normal, 2);
-    delay_us(2000);
 }
 
 void ENS210::measure() {
@@ -64,15 +96,13 @@ void ENS210::measure() {
     i2c1::instance().write(i2c_addr, (uint8_t *)&th_start_single, sizeof(th_start_single));
 }
 
-void ENS210::wait() {
-    if (!devicePresent) return;
+bool ENS210::busy() {
+    if (!devicePresent) return false;
     static uint8_t th_sens_stat = 0x24;
     static uint8_t th_stat = 0;
-    do {
-        i2c1::instance().write(i2c_addr, (uint8_t *)&th_sens_stat, sizeof(th_sens_stat));
-        i2c1::instance().read(i2c_addr, (uint8_t *)&th_stat, sizeof(th_stat));
-        delay_us(2000);
-    } while (th_stat);
+    i2c1::instance().write(i2c_addr, (uint8_t *)&th_sens_stat, sizeof(th_sens_stat));
+    i2c1::instance().read(i2c_addr, (uint8_t *)&th_stat, sizeof(th_stat));
+    return th_stat != 0;
 }
 
 void ENS210::read() {
@@ -95,21 +125,32 @@ void ENS210::read() {
     float H = (float)h_data/51200;
     humidity = H;
     humidityRaw = static_cast<uint16_t>(h_data);
+
+    measureTime = Timeline::SystemTime();
 }
 
 void ENS210::update() {
     if (!devicePresent) return;
-    read();
-    measure();
+    if (state == Idle) {
+        schedule(Measure, 0.0);
+    }
 }
 
 void ENS210::init() {
+    stepEvent.duration = 0.0;
+    stepEvent.startFunc = [this](Timeline::Span &) {
+        step();
+    };
+    stepEvent.doneFunc = [this](Timeline::Span &) {
+        state = nextState;
+        if (state != Idle) {
+            stepEvent.time = Timeline::SystemTime() + nextDelay;
+            Timeline::instance().Add(stepEvent);
+        }
+    };
+
     if (!devicePresent) return;
-    reset();
-    measure();
-    wait();
-    read();
-    stats();
+    schedule(Reset, 0.0);
 }
 
 void ENS210::stats() {
@@ -25,15 +25,20 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdint.h>
 
+#include "./timeline.h"
+
 class ENS210 {
 public:
     static ENS210 &instance();
 
+    // Idle tick, starts a measurement unless one is in flight
     void update();
     void stats();
 
     float Temperature() const { return temperature; }
     float Humidity() const { return humidity; }
+    // Timeline::SystemTime() of the last completed measurement, 0 if none yet
+    double Time() const { return measureTime; }
 
 private:
     friend class i2c1;
@@ -45,14 +50,39 @@ private:
 
     float temperature = 0.0f;
     float humidity = 0.0f;
+    double measureTime = 0.0;
 
     uint16_t temperatureRaw = 0;
     uint16_t humidityRaw = 0;
 
+    // Every step issues one short I2C transfer and schedules the next one
+    // through a Timeline event, nothing here busy waits.
+    enum State {
+        Idle,
+        Reset,
+        Normal,
+        Measure,
+        Read
+    };
+
+    static constexpr double resetTime = 0.002;
+    static constexpr double conversionTime = 0.130;
+    static constexpr double pollTime = 0.010;
+
+    void step();
+    void schedule(State next, double delay);
+
     void reset();
-    void read();
+    void normal();
     void measure();
-    void wait();
+    bool busy();
+    void read();
+
+    State state = Idle;
+    State nextState = Idle;
+    double nextDelay = 0.0;
+    bool reported = false;
+    Timeline::Event stepEvent;
 
     void init();
     bool initialized = false;
@@ -28,7 +28,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <math.h>
 #include <bit>
 
+#if defined(__arm__)
 #include "M480.h"
+#endif  // #if defined(__arm__)
 
 __attribute__ ((hot, optimize("Os"), flatten, always_inline))
 static constexpr float fast_rcp(const float x) { // 23.8bits of accuracy
@@ -47,7 +49,7 @@ static constexpr float fast_rcp(const float x) { // 23.8bits of accuracy
 }
 
 __attribute__ ((hot, optimize("Os"), flatten, always_inline))
-static constexpr float fast_cbrtf(const float x) { // 22.84bits of accuracy
+static constexpr float fast_cbrtf(const float x) { // 22.65bits of accuracy
     // https://www.mdpi.com/1996-1073/14/4/1058=
     float k1 = 1.7523196760f;
     float k2 = 1.2509524245f;
@@ -59,12 +61,12 @@ static constexpr float fast_cbrtf(const float x) { // 22.84bits of accuracy
     y = y * (k1 - c * (k2 - k3 * c));
     float d = x * y * y;
     c = fmaf(-d, y, 1.0f);
-    y = d * fmaf(1.0f / 3.0f, c, 1.0f);
+    y = d * fmaf(2.0f / 3.0f, c, 1.0f); // cbrt = x * rcbrt^2, so the rcbrt correction doubles
     return y;
 }
 
 __attribute__ ((hot, optimize("Os"), flatten, always_inline)) 
-static constexpr float fast_rcbrtf(const float x) { // 22.84bits of accuracy
+static constexpr float fast_rcbrtf(const float x) { // 22.73bits of accuracy
     // https://www.mdpi.com/1996-1073/14/4/1058=
     float k1 = 1.7523196760f;
     float k2 = 1.2509524245f;
@@ -81,7 +83,7 @@ static constexpr float fast_rcbrtf(const float x) { // 22.84bits of accuracy
 
 
 __attribute__ ((hot, optimize("Os"), flatten, always_inline))
-static constexpr float fast_sqrtf(const float x) { // 23.62bits of accuracy
+static constexpr float fast_sqrtf(const float x) { // 23.40bits of accuracy
 #if (__FPU_PRESENT == 1) && (__FPU_USED == 1)
 	return __builtin_sqrtf(x);
 #else  // #if (__FPU_PRESENT == 1) && (__FPU_USED == 1)
@@ -106,7 +108,7 @@ static constexpr float fast_sqrtf(const float x) { // 23.62bits of accuracy
 }
 
 __attribute__ ((hot, optimize("Os"), flatten, always_inline))
-static constexpr float fast_rsqrtf(const float x) { // 23.40bits of accuracy
+static constexpr float fast_rsqrtf(const float x) { // 23.62bits of accuracy
     // https://www.mdpi.com/2079-3197/9/2/21
     int32_t i = std::bit_cast<int>(x);
     int k = i & 0x00800000;
@@ -27,6 +27,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./ens210.h"
 #include "./lsm6dsm.h"
 #include "./mmc5633njl.h"
+#include "./leds.h"
+#include "./ics43434.h"
 
 #include "M480.h"
 
@@ -84,16 +86,19 @@ void i2c1::init() {
     checkReady<BQ25895>();
     checkReady<ENS210>();
     checkReady<MMC5633NJL>();
+    checkReady<LSM6DSM>();
 }
 
 void i2c1::update() {
     checkReadyReprobe<BQ25895>();
     checkReadyReprobe<ENS210>();
     checkReadyReprobe<MMC5633NJL>();
+    checkReadyReprobe<LSM6DSM>();
 
     update<BQ25895>();
     update<ENS210>();
     update<MMC5633NJL>();
+    update<LSM6DSM>();
 }
 
 void i2c1::write(uint8_t _u8PeripheralAddr, uint8_t data[], size_t _u32wLen) {
@@ -261,11 +266,14 @@ void i2c2::PDMA_IRQHandler(void) {
         PDMA->TDSTS = 0x1 << I2C2_PDMA_TX_CH;
         pdmaDone = true;
     }
+    if(u32Status & ((0x1 << Leds::SPI1_MASTER_TX_DMA_CH) | (0x1 << Leds::SPI2_MASTER_TX_DMA_CH))) {
+        Leds::instance().PDMA_IRQHandler();
+    }
     if(u32Status & (0x1 << 2)) {
         PDMA->TDSTS = 0x1 << 2;
     }
-    if(u32Status & (0x1 << 3)) {
-        PDMA->TDSTS = 0x1 << 3;
+    if(u32Status & (0x1 << ICS43434::I2S0_PDMA_RX_CH)) {
+        ICS43434::instance().PDMA_IRQHandler();
     }
 }
 
@@ -25,33 +25,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "M480.h"
 
+#include <algorithm>
+#include <numbers>
+#include <math.h>
 #include <stdio.h>
 
-static constexpr size_t buffLen = 4096;
-static uint32_t PcmBuff[buffLen] = {0};
-static uint32_t volatile u32BuffPos = 0;
-
-extern "C" {
-
-void I2S0_IRQHandler(void) {
-    uint32_t u32Reg = I2S_GET_INT_FLAG(I2S0, I2S_STATUS0_TXTHIF_Msk | I2S_STATUS0_RXTHIF_Msk);
-    if (u32Reg & I2S_STATUS0_RXTHIF_Msk) {
-        if (u32BuffPos < (buffLen-8)) {
-            uint32_t *pBuffRx = &PcmBuff[u32BuffPos];
-            size_t u32Len = I2S_GET_RX_FIFO_LEVEL(I2S0);
-            for (size_t i = 0; i < u32Len; i++ ) {
-                pBuffRx[i] = I2S_READ_RX_FIFO(I2S0);
-            }
-            u32BuffPos += u32Len;
-            if (u32BuffPos >= buffLen) {
-                u32BuffPos =    0;
-            }
-        }
-    }
-}
-
-}
-
 ICS43434 &ICS43434::instance() {
     static ICS43434 ics43434;
     if (!ics43434.initialized) {
@@ -62,13 +40,113 @@ ICS43434 &ICS43434::instance() {
 }
 
 void ICS43434::init() {
-    I2S_Open(I2S0, I2S_MODE_SLAVE, 16000, I2S_DATABIT_24, I2S_ENABLE_MONO, I2S_FORMAT_I2S);
-    NVIC_EnableIRQ(I2S0_IRQn);
+    arm_rfft_fast_init_f32(&fft, fftN);
+
+    for (size_t c = 0; c < fftN; c++) {
+        window[c] = 0.5f - 0.5f * cosf(2.0f * float(std::numbers::pi) * float(c) / float(fftN));
+    }
+
+    SetRate(8000);
 
+    // Circular scatter-gather list, one descriptor per block
+    for (size_t c = 0; c < blocksN; c++) {
+        dmaDesc[c].CTL = ( ( blockN - 1 ) << PDMA_DSCT_CTL_TXCNT_Pos ) | PDMA_WIDTH_32 | PDMA_SAR_FIX | PDMA_DAR_INC | PDMA_REQ_SINGLE | PDMA_OP_SCATTER;
+        dmaDesc[c].SA = uint32_t(reinterpret_cast<uintptr_t>(&I2S0->RXFIFO));
+        dmaDesc[c].DA = uint32_t(reinterpret_cast<uintptr_t>(dmaBuf[c].data()));
+        dmaDesc[c].NEXT = uint32_t(reinterpret_cast<uintptr_t>(&dmaDesc[( c + 1 ) % blocksN])) - PDMA->SCATBA;
+    }
+
+    PDMA_Open(PDMA, 1UL << I2S0_PDMA_RX_CH);
+    PDMA_SetTransferMode(PDMA, I2S0_PDMA_RX_CH, PDMA_I2S0_RX, 1, uint32_t(reinterpret_cast<uintptr_t>(&dmaDesc[0])));
+    PDMA_EnableInt(PDMA, I2S0_PDMA_RX_CH, PDMA_INT_TRANS_DONE);
+
+    I2S_Open(I2S0, I2S_MODE_SLAVE, captureRate, I2S_DATABIT_24, I2S_ENABLE_MONO, I2S_FORMAT_I2S);
     I2S_EnableMCLK(I2S0, 12000000);
-    I2S_EnableInt(I2S0, I2S_IEN_RXTHIEN_Msk);
+    I2S_ENABLE_RXDMA(I2S0);
     I2S_ENABLE_RX(I2S0);
+
+    printf("ICS43434 initialized.\n");
+}
+
+void ICS43434::PDMA_IRQHandler() {
+    PDMA->TDSTS = 1UL << I2S0_PDMA_RX_CH;
+    blocksDone = blocksDone + 1;
+}
+
+void ICS43434::SetRate(uint32_t rate) {
+    decimation = std::clamp(captureRate / std::max(rate, 1U), 1U, 8U);
+    decimationCount = 0;
+    decimationSum = 0.0f;
+
+    // Log spaced from the first bin above DC to Nyquist, at least one bin per band
+    const float lo = 1.0f;
+    const float hi = float(fftN / 2);
+    bandEdges[0] = 1;
+    for (size_t c = 1; c <= bandsN; c++) {
+        uint32_t edge = uint32_t(lo * powf(hi / lo, float(c) / float(bandsN)) + 0.5f);
+        bandEdges[c] = uint16_t(std::min(std::max(edge, uint32_t(bandEdges[c - 1] + 1)), uint32_t(fftN / 2)));
+    }
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void ICS43434::process(const uint32_t *block) {
+    for (size_t c = 0; c < blockN; c++) {
+        // 24 bit sample right aligned in the FIFO word
+        float v = float(int32_t(block[c] << 8) >> 8) * ( 1.0f / 8388608.0f );
+        decimationSum += v;
+        if (++decimationCount >= decimation) {
+            v = decimationSum / float(decimation);
+            decimationSum = 0.0f;
+            decimationCount = 0;
+
+            // One pole DC blocker, the mic has a large offset
+            dc += ( v - dc ) * ( 1.0f / 256.0f );
+            history[historyPos] = v - dc;
+            historyPos = ( historyPos + 1 ) % fftN;
+            historyNew = true;
+        }
+    }
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void ICS43434::analyze() {
+    // Oldest sample first
+    float sum = 0.0f;
+    for (size_t c = 0; c < fftN; c++) {
+        float v = history[( historyPos + c ) % fftN];
+        sum += v * v;
+        fftIn[c] = v * window[c];
+    }
+    rms = sqrtf(sum * ( 1.0f / float(fftN) ));
+
+    arm_rfft_fast_f32(&fft, fftIn.data(), fftOut.data(), 0);
+
+    // fftOut[0] and fftOut[1] are the real DC and Nyquist terms, complex bins follow
+    power[0] = fftOut[0] * fftOut[0];
+    arm_cmplx_mag_squared_f32(&fftOut[2], &power[1], fftN / 2 - 1);
+
+    const float scale = 1.0f / float(fftN * fftN);
+    for (size_t b = 0; b < bandsN; b++) {
+        float e = 0.0f;
+        for (size_t c = bandEdges[b]; c < bandEdges[b + 1]; c++) {
+            e += power[c];
+        }
+        bands[b] = e * scale / float(bandEdges[b + 1] - bandEdges[b]);
+    }
 }
 
 void ICS43434::update() {
+    uint32_t done = blocksDone;
+    if (done - blocksProcessed >= blocksN) {
+        // The block being processed would be written again, drop to the most recent complete ones
+        overruns += done - blocksProcessed - ( blocksN - 1 );
+        blocksProcessed = done - ( blocksN - 1 );
+    }
+    for (; blocksProcessed != done; blocksProcessed++) {
+        process(dmaBuf[blocksProcessed % blocksN].data());
+    }
+    if (historyNew) {
+        historyNew = false;
+        analyze();
+    }
 }
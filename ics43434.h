@@ -27,13 +27,72 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <memory.h>
 #include <stdint.h>
 
+#include "M480.h"
+#include "arm_math.h"
+
+// Microphone front end. PDMA captures I2S0 into a ring of blocks, the IRQ only counts finished
+// blocks. update() decimates what arrived since the last call and runs one real FFT.
 class ICS43434 {
 public:
     static ICS43434 &instance();
+
+    static constexpr uint32_t I2S0_PDMA_RX_CH = 3;
+
+    static constexpr uint32_t captureRate = 16000;
+    static constexpr size_t fftN = 256;
+    static constexpr size_t bandsN = 16;
+
+    // Once per effect frame
     void update();
+
+    // Analysis rate, captureRate divided by 1 to 8
+    void SetRate(uint32_t rate);
+    uint32_t Rate() const { return captureRate / decimation; }
+
+    // Of the last fftN samples at the analysis rate, full scale is 1
+    float RMS() const { return rms; }
+    // Mean power per log spaced band, lowest band first
+    const std::array<float, bandsN> &Bands() const { return bands; }
+    float Band(size_t index) const { return bands[index % bandsN]; }
+
+    size_t Overruns() const { return overruns; }
+
+    void PDMA_IRQHandler();
+
 private:
+    static constexpr size_t blocksN = 4;
+    static constexpr size_t blockN = 128;
+
+    void process(const uint32_t *block);
+    void analyze();
+
+    std::array<std::array<uint32_t, blockN>, blocksN> dmaBuf;
+    std::array<DSCT_T, blocksN> dmaDesc;
+    volatile uint32_t blocksDone = 0;
+    uint32_t blocksProcessed = 0;
+    size_t overruns = 0;
+
+    uint32_t decimation = 2;
+    uint32_t decimationCount = 0;
+    float decimationSum = 0.0f;
+    float dc = 0.0f;
+
+    std::array<float, fftN> history = { };
+    size_t historyPos = 0;
+    bool historyNew = false;
+
+    arm_rfft_fast_instance_f32 fft;
+    std::array<float, fftN> window;
+    std::array<float, fftN> fftIn;
+    std::array<float, fftN> fftOut;
+    std::array<float, fftN / 2> power;
+    std::array<uint16_t, bandsN + 1> bandEdges = { };
+
+    std::array<float, bandsN> bands = { };
+    float rms = 0.0f;
+
     void init();
     bool initialized = false;
 };
 
-#endif /* _ICS43434_H_ */
\ No newline at end of file
+#endif /* _ICS43434_H_ */
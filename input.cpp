@@ -23,6 +23,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./input.h"
 #include "./timeline.h"
 #include "./model.h"
+#include "./lsm6dsm.h"
 
 #include "M480.h"
 
@@ -33,7 +34,8 @@ void GPA_IRQHandler(void)
     // ACCEL_INT1
     if(GPIO_GET_INT_FLAG(PA, BIT9))
     {
-        GPIO_CLR_INT_FLAG(PA, BIT8);
+        if (PA9) LSM6DSM::interrupt();
+        GPIO_CLR_INT_FLAG(PA, BIT9);
     }
 
     // ACCEL_INT2
@@ -26,12 +26,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./leds.h"
 #include "./color.h"
 #include "./model.h"
+#include "./profiler.h"
 
 #include <memory.h>
 
-#define SPI1_MASTER_TX_DMA_CH   0
-#define SPI2_MASTER_TX_DMA_CH   1
-
 Leds &Leds::instance() {
     static Leds leds;
     if (!leds.initialized) {
@@ -43,7 +41,7 @@ Leds &Leds::instance() {
 
 struct Leds::Map Leds::map;
 
-const Leds::lut_table Leds::lut;
+const Leds::lut_table<Leds::spiDataWidth == 32> Leds::lut;
 
 void Leds::init() {
 
@@ -54,8 +52,8 @@ void Leds::init() {
 
     black();
 
-    SPI_Open(SPI1, SPI_MASTER, SPI_MODE_0, 8, 4000000);
-    SPI_Open(SPI2, SPI_MASTER, SPI_MODE_0, 8, 4000000);
+    SPI_Open(SPI1, SPI_MASTER, SPI_MODE_0, spiDataWidth, 4000000);
+    SPI_Open(SPI2, SPI_MASTER, SPI_MODE_0, spiDataWidth, 4000000);
 
     GPIO_SetMode(PC, BIT6, GPIO_MODE_OUTPUT);
     PC6 = 0;
@@ -66,95 +64,186 @@ void Leds::init() {
 #ifdef USE_SPI_DMA
     PDMA_Open(PDMA, (1UL << SPI1_MASTER_TX_DMA_CH) | (1UL << SPI2_MASTER_TX_DMA_CH));
 
-    PDMA_SetTransferCnt(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_WIDTH_8, ledsDMABuf[0].size() * sizeof(uint32_t));
-    PDMA_SetTransferAddr(PDMA, SPI1_MASTER_TX_DMA_CH, reinterpret_cast<uintptr_t>(ledsDMABuf[0].data()), PDMA_SAR_INC, reinterpret_cast<uintptr_t>(&SPI1->TX), PDMA_DAR_FIX);
-    PDMA_SetTransferMode(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_SPI1_TX, FALSE, 0);
+    PDMA_SetTransferAddr(PDMA, SPI1_MASTER_TX_DMA_CH, reinterpret_cast<uintptr_t>(ledsDMABuf[0][0].data()), PDMA_SAR_INC, reinterpret_cast<uintptr_t>(&SPI1->TX), PDMA_DAR_FIX);
     PDMA_SetBurstType(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
-    PDMA->DSCT[SPI1_MASTER_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+    PDMA_EnableInt(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_INT_TRANS_DONE);
 
-    PDMA_SetTransferCnt(PDMA, SPI2_MASTER_TX_DMA_CH, PDMA_WIDTH_8, ledsDMABuf[1].size() * sizeof(uint32_t));
-    PDMA_SetTransferAddr(PDMA, SPI2_MASTER_TX_DMA_CH, reinterpret_cast<uintptr_t>(ledsDMABuf[1].data()), PDMA_SAR_INC, reinterpret_cast<uintptr_t>(&SPI2->TX), PDMA_DAR_FIX);
-    PDMA_SetTransferMode(PDMA, SPI2_MASTER_TX_DMA_CH, PDMA_SPI2_TX, FALSE, 0);
+    PDMA_SetTransferAddr(PDMA, SPI2_MASTER_TX_DMA_CH, reinterpret_cast<uintptr_t>(ledsDMABuf[0][1].data()), PDMA_SAR_INC, reinterpret_cast<uintptr_t>(&SPI2->TX), PDMA_DAR_FIX);
     PDMA_SetBurstType(PDMA, SPI2_MASTER_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
-    PDMA->DSCT[SPI2_MASTER_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+    PDMA_EnableInt(PDMA, SPI2_MASTER_TX_DMA_CH, PDMA_INT_TRANS_DONE);
 #endif  // #ifdef USE_SPI_DMA
 
     printf("Leds initialized.\n");
 }
 
-void Leds::prepare() {
+void Leds::prepare(size_t side) {
+    Profiler::Scope profile(Profiler::Prepare);
     static color::convert converter;
 
-    float brightness = Model::instance().Brightness();
+    converter.OKLAB2WS2816(output.circle[side].data(), &pixels[side][0], circleLedsN, ledTransfer);
+    converter.OKLAB2WS2816(output.bird[side].data(), &pixels[side][circleLedsN], birdLedsN, ledTransfer);
+}
 
-    uint32_t *ptr0 = ledsDMABuf[0].data();
-    uint32_t *ptr1 = ledsDMABuf[1].data();
-    
-    for (size_t c = 0; c < circleLedsN; c++) {
-        color::rgba<uint16_t> pixel0(color::rgba<uint16_t>(converter.OKLAB2LED(circleLeds[0][c]*brightness).clamp()).fix_for_ws2816());
-        color::rgba<uint16_t> pixel1(color::rgba<uint16_t>(converter.OKLAB2LED(circleLeds[1][(c-1)%circleLedsN]*brightness).clamp()).fix_for_ws2816());
-
-        auto convert_to_one_wire_spi = [] (uint32_t *p, uint16_t v) {
-            *p++ = lut[(v>>8)&0xFF];
-            *p++ = lut[(v>>0)&0xFF];
-            return p;
-        };
-
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.g);
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.r);
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.b);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.g);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.r);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.b);
+void Leds::limit() {
+    uint32_t sum = 0;
+    for (const auto &side : pixels) {
+        for (const color::rgba<uint16_t> &pixel : side) {
+            sum += uint32_t(pixel.r) + uint32_t(pixel.g) + uint32_t(pixel.b);
+        }
+    }
+
+    const float idle = float(ledsN) * ledIdleCurrent;
+    current = idle + float(sum) * ( channelMaxCurrent / 65535.0f );
 
+    uint32_t target = 65536;
+    float budget = Model::instance().CurrentBudget();
+    // A budget at or below the idle draw with a black frame would be 0/0 below,
+    // there is nothing to scale down then anyway.
+    if (current > budget && current > idle) {
+        target = uint32_t(65536.0f * std::max(budget - idle, 0.0f) / ( current - idle ));
     }
 
-    for (size_t c = 0; c < birdLedsN; c++) {
-        color::rgba<uint16_t> pixel0(color::rgba<uint16_t>(converter.OKLAB2LED(birdLeds[0][c]*brightness).clamp()).fix_for_ws2816());
-        color::rgba<uint16_t> pixel1(color::rgba<uint16_t>(converter.OKLAB2LED(birdLeds[1][c]*brightness).clamp()).fix_for_ws2816());
-
-        auto convert_to_one_wire_spi = [] (uint32_t *p, uint16_t v) {
-            *p++ = lut[(v>>8)&0xFF];
-            *p++ = lut[(v>>0)&0xFF];
-            return p;
-        };
-
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.g);
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.r);
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.b);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.g);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.r);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.b);
+    // Scale down immediately to avoid brownouts, recover over ~16 frames
+    if (target < currentScale) {
+        currentScale = target;
+    } else {
+        currentScale += ( target - currentScale + 15 ) / 16;
     }
+}
 
+void Leds::encode(size_t side, size_t buf) {
+    auto convert_to_one_wire_spi = [] (uint32_t *p, uint16_t v) {
+        *p++ = lut[(v>>8)&0xFF];
+        *p++ = lut[(v>>0)&0xFF];
+        return p;
+    };
+
+    const uint32_t scale = currentScale;
+    auto scaled = [scale] (uint16_t v) {
+        return uint16_t(( uint32_t(v) * scale ) >> 16);
+    };
+
+    uint32_t *ptr = ledsDMABuf[buf][side].data();
+
+    for (size_t c = 0; c < circleLedsN + birdLedsN; c++) {
+        // Ring on side 1 is offset by one LED
+        const color::rgba<uint16_t> &pixel = pixels[side][(side == 0 || c >= circleLedsN) ? c : (c-1)%circleLedsN];
+        if (scale < 65536) {
+            ptr = convert_to_one_wire_spi(ptr, scaled(pixel.g));
+            ptr = convert_to_one_wire_spi(ptr, scaled(pixel.r));
+            ptr = convert_to_one_wire_spi(ptr, scaled(pixel.b));
+        } else {
+            ptr = convert_to_one_wire_spi(ptr, pixel.g);
+            ptr = convert_to_one_wire_spi(ptr, pixel.r);
+            ptr = convert_to_one_wire_spi(ptr, pixel.b);
+        }
+    }
 }
 
-__attribute__ ((hot, optimize("Os"), flatten))
-void Leds::transfer() {
-    prepare();
+void Leds::start(size_t side, size_t buf) {
+    frontBuf[side] = buf;
+
+    SPI_T *spi = side == 0 ? SPI1 : SPI2;
 
 #ifdef USE_SPI_DMA
 
-    PDMA_SetTransferCnt(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_WIDTH_8, ledsDMABuf[0].size() * sizeof(uint32_t));
-    PDMA_SetTransferMode(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_SPI1_TX, FALSE, 0);
-    SPI_TRIGGER_TX_PDMA(SPI1);
+    const uint32_t ch = dmaChannel(side);
 
-    PDMA_SetTransferCnt(PDMA, SPI2_MASTER_TX_DMA_CH, PDMA_WIDTH_8, ledsDMABuf[1].size() * sizeof(uint32_t));
-    PDMA_SetTransferMode(PDMA, SPI2_MASTER_TX_DMA_CH, PDMA_SPI2_TX, FALSE, 0);
-    SPI_TRIGGER_TX_PDMA(SPI2);
+    dmaBusy = dmaBusy | ( 1UL << ch );
+
+#ifdef USE_SPI_32BIT
+    PDMA_SetTransferCnt(PDMA, ch, PDMA_WIDTH_32, ledsDMABuf[buf][side].size());
+#else  // #ifdef USE_SPI_32BIT
+    PDMA_SetTransferCnt(PDMA, ch, PDMA_WIDTH_8, ledsDMABuf[buf][side].size() * sizeof(uint32_t));
+#endif  // #ifdef USE_SPI_32BIT
+    PDMA_SetTransferAddr(PDMA, ch, reinterpret_cast<uintptr_t>(ledsDMABuf[buf][side].data()), PDMA_SAR_INC, reinterpret_cast<uintptr_t>(&spi->TX), PDMA_DAR_FIX);
+    PDMA_SetTransferMode(PDMA, ch, side == 0 ? PDMA_SPI1_TX : PDMA_SPI2_TX, FALSE, 0);
+    SPI_TRIGGER_TX_PDMA(spi);
 
 #else  // #ifdef USE_DMA
 
-    for(size_t c = 0; c < ledsDMABuf[0].size() * sizeof(uint32_t); c++) {
-        while(SPI_GET_TX_FIFO_FULL_FLAG(SPI1) == 1) {}
-        SPI_WRITE_TX(SPI1, reinterpret_cast<uint8_t *>(ledsDMABuf[0].data())[c]);
+#ifdef USE_SPI_32BIT
+    for(size_t c = 0; c < ledsDMABuf[buf][side].size(); c++) {
+        while(SPI_GET_TX_FIFO_FULL_FLAG(spi) == 1) {}
+        SPI_WRITE_TX(spi, ledsDMABuf[buf][side][c]);
     }
-
-    for(size_t c = 0; c < ledsDMABuf[1].size() * sizeof(uint32_t); c++) {
-        while(SPI_GET_TX_FIFO_FULL_FLAG(SPI2) == 1) {}
-        SPI_WRITE_TX(SPI2, reinterpret_cast<uint8_t *>(ledsDMABuf[1].data())[c]);
+#else  // #ifdef USE_SPI_32BIT
+    for(size_t c = 0; c < ledsDMABuf[buf][side].size() * sizeof(uint32_t); c++) {
+        while(SPI_GET_TX_FIFO_FULL_FLAG(spi) == 1) {}
+        SPI_WRITE_TX(spi, reinterpret_cast<uint8_t *>(ledsDMABuf[buf][side].data())[c]);
     }
+#endif  // #ifdef USE_SPI_32BIT
 
 #endif  // #ifdef USE_DMA
+}
+
+void Leds::PDMA_IRQHandler() {
+    uint32_t status = PDMA->TDSTS & ((1UL << SPI1_MASTER_TX_DMA_CH) | (1UL << SPI2_MASTER_TX_DMA_CH));
+    PDMA->TDSTS = status;
+    dmaBusy = dmaBusy & ~status;
+    for (size_t s = 0; s < sidesN; s++) {
+        if ((status & (1UL << dmaChannel(s))) && frameQueued[s]) {
+            frameQueued[s] = false;
+            start(s, frontBuf[s] ^ 1);
+        }
+    }
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+Leds::FrameStatus Leds::transfer() {
+    Profiler::Scope profile(Profiler::Transfer);
+    FrameStatus status = FrameSkipped;
+
+    float brightness = Model::instance().Brightness();
+
+    // Only rebuilds when the brightness level changed
+    ledTransfer.set(brightness);
+
+    std::array<bool, sidesN> changed = { };
+    for (size_t s = 0; s < sidesN; s++) {
+        uint32_t h = hash(s, brightness);
+        if (!frameHashValid || h != frameHash[s]) {
+            frameHash[s] = h;
+            prepare(s);
+            changed[s] = true;
+        }
+    }
+    frameHashValid = true;
+
+    limit();
+
+    for (size_t s = 0; s < sidesN; s++) {
+        if (!changed[s] && encodedScale[s] == currentScale) {
+            skipped++;
+            continue;
+        }
+        encodedScale[s] = currentScale;
+
+        // Take back a queued frame so the IRQ does not start the buffer we are about to overwrite
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if (frameQueued[s]) {
+            frameQueued[s] = false;
+            dropped++;
+            status = FrameDropped;
+        }
+        size_t backBuf = frontBuf[s] ^ 1;
+        __set_PRIMASK(primask);
+
+        encode(s, backBuf);
+        sent++;
+
+        primask = __get_PRIMASK();
+        __disable_irq();
+        if ((dmaBusy & (1UL << dmaChannel(s))) == 0) {
+            start(s, backBuf);
+            status = std::max(status, FrameStarted);
+        } else {
+            frameQueued[s] = true;
+            status = std::max(status, FrameQueued);
+        }
+        __set_PRIMASK(primask);
+    }
 
+    return status;
 }
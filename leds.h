@@ -27,8 +27,12 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <numbers>
 #include <cmath>
+#include <span>
+#include <algorithm>
+#include <bit>
 
 #define USE_SPI_DMA 1
+#define USE_SPI_32BIT 1
 
 class Leds {
 public:
@@ -37,9 +41,55 @@ public:
     static constexpr size_t birdLedsN = 8;
     static constexpr size_t ledsN = ( circleLedsN + birdLedsN ) * sidesN;
 
+    static constexpr uint32_t SPI1_MASTER_TX_DMA_CH = 0;
+    static constexpr uint32_t SPI2_MASTER_TX_DMA_CH = 1;
+
     static Leds &instance();
 
-    void apply() { transfer(); }
+    // One full set of LED colors, the output framebuffer and compositor layers share this layout
+    struct Frame {
+        std::array<std::array<vector::float4, circleLedsN>, sidesN> circle = { };
+        std::array<std::array<vector::float4, birdLedsN>, sidesN> bird = { };
+    };
+
+    // Redirect all LED writes and reads into frame, nullptr restores the output framebuffer
+    void setTarget(Frame *frame) { renderTarget = frame ? frame : &output; }
+    Frame &getOutput() { return output; }
+
+    enum FrameStatus {
+        FrameSkipped,   // unchanged on both sides, nothing was sent
+        FrameStarted,   // went out on the wire immediately
+        FrameQueued,    // goes out when the frame currently on the wire completes
+        FrameDropped    // replaced a queued frame which was never shown
+    };
+
+    FrameStatus apply() { return transfer(); }
+    size_t droppedFrames() const { return dropped; }
+    size_t sentFrames() const { return sent; }
+    size_t skippedFrames() const { return skipped; }
+
+    // Estimated LED current of the last frame before limiting in mA, and the applied scale
+    float estimatedCurrent() const { return current; }
+    float currentLimitScale() const { return float(currentScale) * ( 1.0f / 65536.0f ); }
+
+    void PDMA_IRQHandler();
+
+    // FNV-1a of one side's colors and the brightness, what change detection compares.
+    // Inline so the host effect harness in tools/ hashes frames the same way.
+    uint32_t hash(size_t side, float brightness) const {
+        // FNV-1a over the raw float bits
+        auto fnv = [](uint32_t h, float v) {
+            return ( h ^ std::bit_cast<uint32_t>(v) ) * 16777619U;
+        };
+        uint32_t h = fnv(2166136261U, brightness);
+        for (const vector::float4 &c : output.circle[side]) {
+            h = fnv(fnv(fnv(h, c.x), c.y), c.z);
+        }
+        for (const vector::float4 &c : output.bird[side]) {
+            h = fnv(fnv(fnv(h, c.x), c.y), c.z);
+        }
+        return h;
+    }
 
     static struct Map {
         
@@ -121,13 +171,13 @@ public:
     vector::float4 &get(size_t index) {
         index %= 2 * ( circleLedsN + birdLedsN );
         if (index >= 2 * circleLedsN + birdLedsN) {
-            return birdLeds[1][index - (2 * circleLedsN + birdLedsN)];
+            return renderTarget->bird[1][index - (2 * circleLedsN + birdLedsN)];
         } else if (index >= 2 * circleLedsN) {
-            return birdLeds[0][index - (2 * circleLedsN)];
+            return renderTarget->bird[0][index - (2 * circleLedsN)];
         } else if (index >= circleLedsN) {
-            return circleLeds[1][index - circleLedsN];
+            return renderTarget->circle[1][index - circleLedsN];
         } else {
-            return circleLeds[0][index];
+            return renderTarget->circle[0][index];
         }
     }
 
@@ -138,7 +188,7 @@ public:
     vector::float4 &getCircle(size_t side, size_t index) {
         side %= sidesN;
         index %= circleLedsN;
-        return circleLeds[side][index];
+        return renderTarget->circle[side][index];
     }
 
     void setBird(size_t side, size_t index, const vector::float4 &c) {
@@ -148,22 +198,40 @@ public:
     vector::float4 &getBird(size_t side, size_t index) {
         side %= sidesN;
         index %= birdLedsN;
-        return birdLeds[side][index];
+        return renderTarget->bird[side][index];
     }
 
-    auto getCircle() { return circleLeds; }
-    auto getBird() { return birdLeds; };
-    void setCircle(auto _circleLeds) { circleLeds = _circleLeds; }
-    void setBird(auto _birdLeds) { birdLeds = _birdLeds; }
+    // Contiguous regions, index 0 is the first LED of the region
+    std::span<vector::float4, circleLedsN> circle(size_t side) { return renderTarget->circle[side % sidesN]; }
+    std::span<vector::float4, birdLedsN> bird(size_t side) { return renderTarget->bird[side % sidesN]; }
 
-private:
+    static void fill(std::span<vector::float4> dst, const vector::float4 &c) {
+        std::fill(dst.begin(), dst.end(), c);
+    }
 
-    static const struct lut_table {
+    static void copy(std::span<vector::float4> dst, std::span<const vector::float4> src) {
+        std::copy_n(src.begin(), std::min(src.size(), dst.size()), dst.begin());
+    }
+
+    // dst[c] = src[n-1-c]
+    static void copyMirrored(std::span<vector::float4> dst, std::span<const vector::float4> src) {
+        size_t n = std::min(src.size(), dst.size());
+        std::reverse_copy(src.begin(), src.begin() + ptrdiff_t(n), dst.begin());
+    }
+
+    // 4 SPI bits per WS2816 bit, 1000 for 0 and 1100 for 1, MSB first. A byte on the wire
+    // carries 2 bits, so one table word encodes 8 bits of a component. With spiWords SPI
+    // shifts 32-bit words MSB first, the table is swapped so the wire sees the same byte
+    // order as 8-bit mode. Public for the host byte order test.
+    template<bool spiWords> struct lut_table {
         consteval lut_table() {
             for (uint32_t c = 0; c < 256; c++) {
                 table[c] = 0x88888888 |
                         (((c >>  4) | (c <<  6) | (c << 16) | (c << 26)) & 0x04040404)|
                         (((c >>  1) | (c <<  9) | (c << 19) | (c << 29)) & 0x40404040);
+                if constexpr (spiWords) {
+                    table[c] = ( table[c] >> 24 ) | ( ( table[c] >> 8 ) & 0x0000FF00 ) | ( ( table[c] << 8 ) & 0x00FF0000 ) | ( table[c] << 24 );
+                }
             }
         }
 
@@ -173,18 +241,63 @@ private:
 
     private:
         uint32_t table[256];
-    } lut;
+    };
+
+private:
 
-    std::array<std::array<vector::float4, circleLedsN>, sidesN> circleLeds = { };
-    std::array<std::array<vector::float4, birdLedsN>, sidesN> birdLeds = { };
+#ifdef USE_SPI_32BIT
+    static constexpr uint32_t spiDataWidth = 32;
+#else  // #ifdef USE_SPI_32BIT
+    static constexpr uint32_t spiDataWidth = 8;
+#endif  // #ifdef USE_SPI_32BIT
+
+    static const lut_table<spiDataWidth == 32> lut;
+
+    Frame output;
+    Frame *renderTarget = &output;
 
     static constexpr size_t bitsPerComponent = 16;
     static constexpr size_t bitsPerLed = bitsPerComponent * 3;
 
-    std::array<std::array<uint32_t, (((birdLedsN + circleLedsN) * bitsPerLed) / 2) / sizeof(uint32_t)>, sidesN> ledsDMABuf __attribute__ ((aligned (16))) = { };
+    static constexpr size_t frameWordsN = (((birdLedsN + circleLedsN) * bitsPerLed) / 2) / sizeof(uint32_t);
+    // WS2816 latch is >280us low, 36 words at 4Mhz are 288us. Makes back to back frames valid.
+    static constexpr size_t resetWordsN = 36;
+
+    // Ping-pong: one buffer is on the wire while the other one is prepared
+    std::array<std::array<std::array<uint32_t, frameWordsN + resetWordsN>, sidesN>, 2> ledsDMABuf __attribute__ ((aligned (16))) = { };
+
+    // Per side, so an unchanged side can skip while the other one flips
+    std::array<volatile size_t, sidesN> frontBuf = { };
+    std::array<volatile bool, sidesN> frameQueued = { };
+    volatile uint32_t dmaBusy = 0;
+
+    color::led_transfer ledTransfer;
+
+    // Converted, unlimited WS2816 codes
+    std::array<std::array<color::rgba<uint16_t>, circleLedsN + birdLedsN>, sidesN> pixels;
+
+    static constexpr float channelMaxCurrent = 12.0f; // mA
+    static constexpr float ledIdleCurrent = 0.6f; // mA
+
+    float current = 0.0f;
+    uint32_t currentScale = 65536;
+    std::array<uint32_t, sidesN> encodedScale = { };
+
+    std::array<uint32_t, sidesN> frameHash = { };
+    bool frameHashValid = false;
+
+    // Counted per side
+    size_t dropped = 0;
+    size_t sent = 0;
+    size_t skipped = 0;
+
+    static constexpr uint32_t dmaChannel(size_t side) { return side == 0 ? SPI1_MASTER_TX_DMA_CH : SPI2_MASTER_TX_DMA_CH; }
 
-    void transfer();
-    void prepare();
+    FrameStatus transfer();
+    void prepare(size_t side);
+    void limit();
+    void encode(size_t side, size_t buf);
+    void start(size_t side, size_t buf);
 
     void init();
     bool initialized = false;
@@ -405,8 +405,9 @@ void RtcSetAlarm(uint32_t timeout) {
         alarmEvent.startFunc = [=](Timeline::Span &) {
             TimerIrqHandler();
         };
-        Timeline::instance().Add(alarmEvent);
     }
+    // Also when already scheduled, so the Timeline picks up the new time
+    Timeline::instance().Add(alarmEvent);
 }
 
 void RtcStopAlarm(void) {
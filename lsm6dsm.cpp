@@ -22,7 +22,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "./lsm6dsm.h"
 #include "./i2cmanager.h"
+#include "./timeline.h"
 
+#include "M480.h"
+
+#include <algorithm>
 #include <stdio.h>
 
 enum {
@@ -139,6 +143,8 @@ static void delay_us(int usec) {
 }
 
 bool LSM6DSM::devicePresent = false;
+volatile bool LSM6DSM::fifoPending = false;
+volatile uint64_t LSM6DSM::fifoStamp = 0;
 
 LSM6DSM &LSM6DSM::instance() {
     static LSM6DSM lsm6dsm;
@@ -156,6 +162,93 @@ void LSM6DSM::update() {
     read();
 }
 
+void LSM6DSM::interrupt() {
+    fifoStamp = Timeline::FastSystemTime();
+    fifoPending = true;
+}
+
+void LSM6DSM::service() {
+    if (!devicePresent || !configured || !fifoPending) {
+        return;
+    }
+
+    // Clear before reading so an edge during the transfer is not lost. The
+    // 64-bit stamp is two accesses on the M4, keep the ISR out while copying.
+    __disable_irq();
+    uint64_t stampTicks = fifoStamp;
+    fifoPending = false;
+    __enable_irq();
+    double stamp = double(stampTicks) / double(Timeline::FastSystemTimeCmp());
+
+    // INT1 is level triggered on the threshold; if it is still up we will not
+    // see another edge, so go again on the next pass.
+    auto rearm = [](uint64_t ticks) {
+        if (PA9) {
+            __disable_irq();
+            fifoStamp = ticks;
+            fifoPending = true;
+            __enable_irq();
+        }
+    };
+
+    uint8_t status[4] = { };
+    uint8_t startReg = LSM6DSM_FIFO_STATUS1;
+    i2c1::instance().writeRead(i2c_addr, &startReg, sizeof(startReg), status, sizeof(status));
+
+    size_t level = size_t(((status[1] & 0x07) << 8) | status[0]);
+    size_t pattern = size_t(((status[3] & 0x03) << 8) | status[2]);
+    if (status[1] & 0x40) {
+        fifoOverruns++;
+    }
+
+    // Realign to the start of a gyro/accel set if we ever got out of step
+    size_t skip = pattern ? (fifoSetWords - pattern) : 0;
+    if (level < skip + fifoSetWords) {
+        rearm(stampTicks);
+        return;
+    }
+    size_t sets = std::min((level - skip) / fifoSetWords, fifoBurstMax - (skip ? 1 : 0));
+    size_t words = skip + sets * fifoSetWords;
+
+    // With IF_INC set reads wrap from FIFO_DATA_OUT_H back to FIFO_DATA_OUT_L
+    startReg = LSM6DSM_FIFO_DATA_OUT_L;
+    i2c1::instance().writeRead(i2c_addr, &startReg, sizeof(startReg), reinterpret_cast<uint8_t *>(fifoData), words * sizeof(int16_t));
+
+    // The interrupt fired when the set at fifoThreshold - 1 landed, the rest
+    // are spaced at the output data rate around it.
+    double period = 1.0 / double(odrHz);
+    const int16_t *data = &fifoData[skip];
+    for (size_t c = 0; c < sets; c++, data += fifoSetWords) {
+        Sample &sample = samples[sampleHead];
+        sample.time = stamp + (double(c) - double(fifoThreshold - 1)) * period;
+        sample.xg = static_cast<float>(data[0]) * gRes;
+        sample.yg = static_cast<float>(data[1]) * gRes;
+        sample.zg = static_cast<float>(data[2]) * gRes;
+        sample.xa = static_cast<float>(data[3]) * aRes;
+        sample.ya = static_cast<float>(data[4]) * aRes;
+        sample.za = static_cast<float>(data[5]) * aRes;
+        latestSample = sample;
+        sampleHead = (sampleHead + 1) & (sampleN - 1);
+        if (sampleHead == sampleTail) {
+            sampleTail = (sampleTail + 1) & (sampleN - 1);
+            samplesDropped++;
+        }
+    }
+
+    // The leftover sets landed right after this batch, so carry the anchor
+    // forward instead of using now.
+    rearm(stampTicks + uint64_t(double(sets) * period * double(Timeline::FastSystemTimeCmp())));
+}
+
+bool LSM6DSM::pop(Sample &sample) {
+    if (sampleHead == sampleTail) {
+        return false;
+    }
+    sample = samples[sampleTail];
+    sampleTail = (sampleTail + 1) & (sampleN - 1);
+    return true;
+}
+
 void LSM6DSM::init() {
     if (!devicePresent) return;
     update();
@@ -240,21 +333,36 @@ void LSM6DSM::config(uint8_t _aScale, uint8_t _gScale, uint8_t _aodr, uint8_t _g
     // enable accel LP2 (bit 7 = 1), set LP2 tp ODR/9 (bit 6 = 1), enable input_composite (bit 3) for low noise
     i2c1::instance().setReg8(i2c_addr, LSM6DSM_CTRL8_XL, 0x80 | 0x40 | 0x08 );
 
+    // The ladder is not a clean doubling of 12.5Hz, 208Hz is code 5
+    static constexpr float odrTable[] = { 0.0f, 12.5f, 26.0f, 52.0f, 104.0f, 208.0f, 416.0f, 833.0f, 1660.0f, 3330.0f, 6660.0f };
+    odrHz = odrTable[aodr < (sizeof(odrTable) / sizeof(odrTable[0])) ? aodr : 0];
+
+    // FIFO: flush by going through bypass, then gyro in dataset 1, accel in
+    // dataset 2, no decimation, continuous mode at the accel ODR. Gyro and accel 
+    // ODR need to match for the fixed G/XL pattern service() expects.
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_FIFO_CTRL5, 0x00);
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_FIFO_CTRL1, uint8_t((fifoThreshold * fifoSetWords) & 0xFF));
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_FIFO_CTRL2, uint8_t(((fifoThreshold * fifoSetWords) >> 8) & 0x07));
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_FIFO_CTRL3, (0x01 << 3) | 0x01);
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_FIFO_CTRL4, 0x00);
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_FIFO_CTRL5, uint8_t(aodr << 3 | 0x06));
+
     // interrupt handling
-    i2c1::instance().setReg8(i2c_addr, LSM6DSM_DRDY_PULSE_CFG, 0x80); // latch interrupt until data read
-    i2c1::instance().setReg8(i2c_addr, LSM6DSM_INT1_CTRL, 0x43);      // enable significant motion interrupts 
-                                                                      // and accel/gyro data ready interrupts on INT1  
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_DRDY_PULSE_CFG, 0x00);
+    i2c1::instance().setReg8(i2c_addr, LSM6DSM_INT1_CTRL, 0x08);      // FIFO threshold on INT1
 
     //i2c1::instance().setReg8(i2c_addr, LSM6DSM_CTRL4_C, 0x40);
 }
 
 void LSM6DSM::read() {
+    // accel/gyro come in through the FIFO, only temperature is polled
     uint8_t startReg = LSM6DSM_OUT_TEMP_L;
-    i2c1::instance().writeRead(i2c_addr, &startReg, sizeof(startReg), (uint8_t *)&lsm6dsmRegs, sizeof(lsm6dsmRegs));
+    i2c1::instance().writeRead(i2c_addr, &startReg, sizeof(startReg), (uint8_t *)&outTemp, sizeof(outTemp));
 }
 
 void LSM6DSM::stats() {
     printf("LSM6DSM temp %fC\r\n", double(temperature()));
     printf("LSM6DSM gyro (X:%f Y:%f Z:%f)\r\n", double(XG()), double(YG()), double(ZG()));
     printf("LSM6DSM accel (X:%f Y:%f Z:%f)\r\n", double(XA()), double(YA()), double(ZA()));
+    printf("LSM6DSM FIFO %fHz, %d samples per batch, %d overruns\r\n", double(odrHz), int(fifoThreshold), int(fifoOverruns));
 }
@@ -24,6 +24,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define _LSM6DSM_
 
 #include <stdint.h>
+#include <stddef.h>
 
 class LSM6DSM {
 public:
@@ -31,15 +32,36 @@ public:
 
     void update();
 
-    float temperature() const { return (static_cast<float>(lsm6dsmRegs.fields.outTemp) * (1.0f/256.f)) + 25.0f; }
+    // Drain the FIFO if the watermark interrupt fired; one status read and
+    // one burst read of FIFO_DATA_OUT per batch. Call from the main loop.
+    void service();
 
-    float XG() const { return static_cast<float>(lsm6dsmRegs.fields.outXG) * gRes; }
-    float YG() const { return static_cast<float>(lsm6dsmRegs.fields.outYG) * gRes; }
-    float ZG() const { return static_cast<float>(lsm6dsmRegs.fields.outZG) * gRes; }
+    // Called from GPA_IRQHandler on the rising edge of INT1 (FIFO threshold)
+    static void interrupt();
 
-    float XA() const { return static_cast<float>(lsm6dsmRegs.fields.outXA) * aRes; }
-    float YA() const { return static_cast<float>(lsm6dsmRegs.fields.outYA) * aRes; }
-    float ZA() const { return static_cast<float>(lsm6dsmRegs.fields.outZA) * aRes; }
+    struct Sample {
+        double time;    // Timeline::SystemTime() seconds
+        float xg, yg, zg;
+        float xa, ya, za;
+    };
+
+    // Timestamped samples in arrival order, oldest first
+    size_t available() const { return (sampleHead - sampleTail) & (sampleN - 1); }
+    bool pop(Sample &sample);
+    const Sample &latest() const { return latestSample; }
+    float rate() const { return odrHz; }
+    uint32_t overruns() const { return fifoOverruns; }
+    uint32_t dropped() const { return samplesDropped; }
+
+    float temperature() const { return (static_cast<float>(outTemp) * (1.0f/256.f)) + 25.0f; }
+
+    float XG() const { return latestSample.xg; }
+    float YG() const { return latestSample.yg; }
+    float ZG() const { return latestSample.zg; }
+
+    float XA() const { return latestSample.xa; }
+    float YA() const { return latestSample.ya; }
+    float ZA() const { return latestSample.za; }
 
 private:
 
@@ -90,25 +112,32 @@ private:
         GODR_6660Hz                     = 0x0A,
     };
 
-    union LSM6DSMRegs {
-        uint8_t regs[14];
-        struct  __attribute__ ((__packed__)) {
-            uint16_t outTemp;
+    // FIFO pattern with equal accel/gyro ODR and no decimation: G xyz, XL xyz
+    static constexpr size_t fifoSetWords = 6;
+    static constexpr size_t fifoThreshold = 16;  // sets per watermark interrupt
+    static constexpr size_t fifoBurstMax = 32;   // sets per burst read
+    static constexpr size_t sampleN = 64;        // must be power of two
+
+    static volatile bool fifoPending;
+    static volatile uint64_t fifoStamp;
+
+    int16_t outTemp = 0;
+
+    int16_t fifoData[fifoBurstMax * fifoSetWords];
 
-            uint16_t outXG;
-            uint16_t outYG;
-            uint16_t outZG;
+    Sample samples[sampleN] = {};
+    size_t sampleHead = 0;
+    size_t sampleTail = 0;
+    Sample latestSample = {};
 
-            uint16_t outXA;
-            uint16_t outYA;
-            uint16_t outZA;
-        } fields;
-    } lsm6dsmRegs = { };
+    uint32_t fifoOverruns = 0;
+    uint32_t samplesDropped = 0;
+    float odrHz = 0.0f;
 
     void config(uint8_t Ascale = AFS_2G, 
                 uint8_t Gscale = GFS_245DPS, 
                 uint8_t AODR = AODR_208Hz, 
-                uint8_t GODR = GODR_416Hz);
+                uint8_t GODR = GODR_208Hz);
 
     bool initialized = false;
     bool configured = false;
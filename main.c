@@ -164,6 +164,10 @@ static void SYS_Init(void)
     CLK_EnableModuleClock(TMR1_MODULE);
     CLK_SetModuleClock(TMR1_MODULE, CLK_CLKSEL1_TMR1SEL_LIRC, MODULE_NoMsk); // LIRC 10Khz
 
+    // I2S0
+    CLK_EnableModuleClock(I2S0_MODULE);
+    CLK_SetModuleClock(I2S0_MODULE, CLK_CLKSEL3_I2S0SEL_HIRC, MODULE_NoMsk); // HIRC 12Mhz
+
     // UART5_TX
     CLK_EnableModuleClock(UART5_MODULE);
     CLK_SetModuleClock(UART5_MODULE, CLK_CLKSEL3_UART5SEL_HIRC, CLK_CLKDIV4_UART5(1)); // HIRC 12Mhz
@@ -186,6 +190,7 @@ static void SYS_DeInit(void)
     CLK_DisableModuleClock(SPI2_MODULE);
     CLK_DisableModuleClock(TMR0_MODULE);
     CLK_DisableModuleClock(TMR1_MODULE);
+    CLK_DisableModuleClock(I2S0_MODULE);
     CLK_DisableModuleClock(UART5_MODULE);
 }
 
@@ -22,9 +22,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "./mmc5633njl.h"
 #include "./i2cmanager.h"
+#include "./timeline.h"
 
 #include <stdio.h>
-#include <memory.h>
 
 enum {
     // Registers
@@ -148,6 +148,19 @@ void MMC5633NJL::update() {
     if (!devicePresent) return;
     reset();
     config();
+    // Temperature is not part of continuous mode, ask for one and let 
+    // sample() pick it up with the next burst.
+    i2c1::instance().setReg8(i2c_addr, MMC5633NJL_REG_CTRL_0, 
+        MMC5633NJL_CTRL_0_TAKE_MEAS_T | MMC5633NJL_CTRL_0_CMM_FREQ_EN | MMC5633NJL_CTRL_0_AUTO_SR_EN);
+}
+
+void MMC5633NJL::sample() {
+    if (!devicePresent || !configured) return;
+    double now = Timeline::SystemTime();
+    if ((now - sampleTime) < (1.0 / double(odr))) {
+        return;
+    }
+    sampleTime = now;
     read();
 }
 
@@ -191,64 +204,26 @@ void MMC5633NJL::reset() {
 }
 
 void MMC5633NJL::config() {
-    // NOP for now
-}
-
-void MMC5633NJL::readTemp() {
-    // Clear old data
-    memset(&mmc5633njlRegs.regs, 0, sizeof(mmc5633njlRegs));
-
-    // Measure temperature
-    i2c1::instance().setReg8(i2c_addr, MMC5633NJL_REG_CTRL_0, 
-        MMC5633NJL_CTRL_0_TAKE_MEAS_T | MMC5633NJL_CTRL_0_AUTO_SR_EN);
-
-    for ( ; ; ) {
-        // Wait for measurement
-        uint8_t status1 = i2c1::instance().getReg8(i2c_addr, MMC5633NJL_REG_STATUS_1);
-        if ( ( status1 & ( MMC5633NJL_STATUS_1_MEAS_T_DONE ) ) == 
-                         ( MMC5633NJL_STATUS_1_MEAS_T_DONE ) ) {
-            break;
-        }
-        delay_us(10);
-    }
-
-    uint8_t *regs = (uint8_t *)&mmc5633njlRegs.regs;
-    // Set start offset for read
-    for (size_t c = 0; c < sizeof(mmc5633njlRegs); c++) {
-        uint8_t val = i2c1::instance().getReg8(i2c_addr, uint8_t(MMC5633NJL_REG_XOUT0 + c));
-        *regs++ = val;
+    if (configured) {
+        return;
     }
-}
 
-void MMC5633NJL::readAccel() {
-    // Clear old data
-    memset(&mmc5633njlRegs.regs, 0, sizeof(mmc5633njlRegs));
+    configured = true;
 
-    // Measure temperature
+    // Continuous measurement at odr, the part does a SET every 100 
+    // measurements on its own and SET/RESET around each one (AUTO_SR_EN)
+    i2c1::instance().setReg8(i2c_addr, MMC5633NJL_REG_ODR, odr);
+    i2c1::instance().setReg8(i2c_addr, MMC5633NJL_REG_CTRL_1, MMC5633NJL_CTRL_1_BW_6_6_MS);
     i2c1::instance().setReg8(i2c_addr, MMC5633NJL_REG_CTRL_0, 
-        MMC5633NJL_CTRL_0_TAKE_MEAS_M | MMC5633NJL_CTRL_0_AUTO_SR_EN);
-
-    for ( ; ; ) {
-        // Wait for measurement
-        uint8_t status1 = i2c1::instance().getReg8(i2c_addr, MMC5633NJL_REG_STATUS_1);
-        if ( ( status1 & ( MMC5633NJL_STATUS_1_MEAS_M_DONE ) ) == 
-                         ( MMC5633NJL_STATUS_1_MEAS_M_DONE ) ) {
-            break;
-        }
-        delay_us(10);
-    }
-
-    uint8_t *regs = (uint8_t *)&mmc5633njlRegs.regs;
-    // Set start offset for read
-    for (size_t c = 0; c < sizeof(mmc5633njlRegs); c++) {
-        uint8_t val = i2c1::instance().getReg8(i2c_addr, uint8_t(MMC5633NJL_REG_XOUT0 + c));
-        *regs++ = val;
-    }
+        MMC5633NJL_CTRL_0_CMM_FREQ_EN | MMC5633NJL_CTRL_0_AUTO_SR_EN);
+    i2c1::instance().setReg8(i2c_addr, MMC5633NJL_REG_CTRL_2, 
+        MMC5633NJL_CTRL_2_COMM_EN | MMC5633NJL_CTRL_2_EN_PRD_SET | MMC5633NJL_CTRL_2_PRD_SET_100_MPS);
 }
 
 void MMC5633NJL::read() {
-    readTemp();
-    readAccel();
+    // One burst over XOUT0..TOUT, no waiting on status in continuous mode
+    uint8_t startReg = MMC5633NJL_REG_XOUT0;
+    i2c1::instance().writeRead(i2c_addr, &startReg, sizeof(startReg), mmc5633njlRegs.regs, sizeof(mmc5633njlRegs.regs));
 }
 
 float MMC5633NJL::X() const {
@@ -304,4 +279,5 @@ uint8_t MMC5633NJL::temperatureRaw() const {
 void MMC5633NJL::stats() {
     printf("MMC5633NJL (temperature: %fC)\r\n", double(temperature()));
     printf("MMC5633NJL (X: %fG) (Y: %fG) (Z: %fG)\r\n", double(X()),  double(Y()), double(Z()));
+    printf("MMC5633NJL continuous at %dHz\r\n", int(odr));
 }
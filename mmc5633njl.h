@@ -29,8 +29,15 @@ class MMC5633NJL {
 public:
     static MMC5633NJL &instance();
 
+    // Idle tick, (re)configures continuous mode and requests a temperature
     void update();
 
+    // Main loop, outside the effect frame. Burst reads the latest 
+    // measurement into the cache at most at odr.
+    void sample();
+
+    // Cached values from the last sample(), never touch the bus
+
     float X() const;
     float Y() const;
     float Z() const;
@@ -41,6 +48,10 @@ public:
     uint32_t ZGRaw() const;
     uint8_t temperatureRaw() const;
 
+    bool present() const { return devicePresent; }
+    // Timeline::SystemTime() of the cached values, 0 if none yet
+    double Time() const { return sampleTime; }
+
 private:
 
     friend class i2c1;
@@ -54,8 +65,6 @@ private:
     void init();
     void stats();
     void status();
-    void readTemp();
-    void readAccel();
 
     void reset();
 
@@ -83,6 +92,10 @@ private:
 
     void config();
 
+    static constexpr uint8_t odr = 50; // Hz, up to 75 with 6.6ms bandwidth
+
+    double sampleTime = 0.0;
+
     bool initialized = false;
     bool configured = false;
     bool resetted = false;
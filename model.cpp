@@ -27,10 +27,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <memory.h>
 
-const uint32_t currentVersion = 0x1ED50002;
+const uint32_t currentVersion = 0x1ED50005;
 
 bool Model::dirty = false;
 bool Model::initialized = false;
+uint32_t Model::scriptEffectCount = 0;
 
 Model &Model::instance() {
     static Model model;
@@ -46,7 +47,7 @@ void Model::init() {
     printf("Model initialized.\n");
 
     bool doSave = false;
-    if (Model::instance().Effect() >= Model::instance().EffectCount()) {
+    if (Model::instance().Effect() >= Model::effectCount) {
         Model::instance().SetEffect(3);
         Model::instance().SetBrightnessLevel(9);
         doSave = true;
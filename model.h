@@ -29,9 +29,15 @@ class Model {
 public:
     static Model &instance();
 
+    // Built in effects come first, scripts from data.bin follow
+    static constexpr uint32_t builtinEffectCount = 33;
+    static constexpr uint32_t scriptEffectMax = 8;
+    static constexpr uint32_t effectCount = builtinEffectCount + scriptEffectMax;
+
     uint32_t Effect() const { return effect; };
     void SetEffect(uint32_t _effect) { effect = _effect % EffectCount(); dirty = true; };
-    uint32_t EffectCount() const { return 33; }
+    uint32_t EffectCount() const { return builtinEffectCount + scriptEffectCount; }
+    void SetScriptEffectCount(uint32_t count) { scriptEffectCount = std::min(count, scriptEffectMax); }
 
     auto BirdColor() const { return bird_color; }
     void SetBirdColor(auto _bird_color) { bird_color = _bird_color; dirty = true; }
@@ -44,6 +50,9 @@ public:
     void SetBrightnessLevel(size_t _brightnessLevel) { brightnessLevel = _brightnessLevel;  dirty = true; }
     size_t BrightnessLevelCount() const { return 11; }
 
+    float CurrentBudget() const { return float(currentBudget); }
+    void SetCurrentBudget(uint32_t _currentBudget) { currentBudget = _currentBudget; dirty = true; }
+
     size_t Switch1Count() const { return switch1Count; }
     void IncSwitch1Count() { switch1Count++; dirty = true; }
 
@@ -68,6 +77,8 @@ public:
 private:
     static bool dirty;
     static bool initialized;
+    // Static so it stays out of the flashed image, VM sets it when data.bin is read
+    static uint32_t scriptEffectCount;
     static constexpr uint32_t dataAddress = 0x7F000; // Last 4KB page
 
     void init();
@@ -95,6 +106,8 @@ private:
 
     size_t brightnessLevel = 3;
 
+    uint32_t currentBudget = 1000; // mA
+
     size_t switch1Count = 0;
     size_t switch2Count = 0;
     size_t switch3Count = 0;
@@ -0,0 +1,80 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef _MOTION_H_
+#define _MOTION_H_
+
+#include <stdint.h>
+
+#include "./vector.h"
+
+// Orientation service. Runs a Madgwick AHRS filter over every LSM6DSM FIFO sample,
+// corrected by the last MMC5633NJL reading when there is one. Published values
+// change once per effect frame so all effects in a frame see the same orientation.
+class Motion {
+public:
+    static Motion &instance();
+
+    // Once per effect frame
+    void update();
+
+    // Rotation from device to earth frame, x y z w. Earth frame is x north, z up.
+    const vector::float4 &Quaternion() const { return quaternion; }
+    // Unit vector towards the ground, in device frame
+    const vector::float4 &Gravity() const { return gravity; }
+    // Unit vector towards magnetic north, in device frame
+    const vector::float4 &Heading() const { return heading; }
+    // Yaw around the earth z axis in radians, -pi..pi
+    float Yaw() const { return yaw; }
+
+    // Samples pushed through the filter since boot
+    uint32_t Samples() const { return samples; }
+
+    void SetBeta(float _beta) { beta = _beta; }
+
+private:
+    void step(float dt, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
+    void step(float dt, float gx, float gy, float gz, float ax, float ay, float az);
+    void publish();
+
+    // w x y z, Madgwick's q0..q3
+    float q0 = 1.0f;
+    float q1 = 0.0f;
+    float q2 = 0.0f;
+    float q3 = 0.0f;
+
+    static constexpr double magTimeout = 0.5;
+
+    float beta = 0.1f;
+    double lastTime = 0.0;
+
+    vector::float4 quaternion = { 0.0f, 0.0f, 0.0f, 1.0f };
+    vector::float4 gravity = { 0.0f, 0.0f, -1.0f };
+    vector::float4 heading = { 1.0f, 0.0f, 0.0f };
+    float yaw = 0.0f;
+    uint32_t samples = 0;
+
+    void init();
+    bool initialized = false;
+};
+
+#endif /* _MOTION_H_ */
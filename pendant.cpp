@@ -32,6 +32,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./ens210.h"
 #include "./lsm6dsm.h"
 #include "./mmc5633njl.h"
+#include "./ics43434.h"
 #include "./lorawan.h"
 
 #include "./effects.h"
@@ -39,6 +40,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./model.h"
 #include "./seed.h"
 #include "./msc.h"
+#include "./profiler.h"
+#include "./vm.h"
+#include "./player.h"
+#include "./motion.h"
 
 #include "M480.h"
 
@@ -56,12 +61,16 @@ Pendant &Pendant::instance() {
 void Pendant::init() {
     Seed::instance(); 
     Model::instance();
+    Profiler::instance();
     Timeline::instance();
     Leds::instance();
     Effects::instance();
+    VM::instance();
     Input::instance();
     i2c1::instance();
     i2c2::instance();
+    ICS43434::instance();
+    Motion::instance();
     UI::instance();
 }
 
@@ -70,6 +79,8 @@ void Pendant::Run() {
     while (1) {
         CLK_Idle();
         Timeline::instance().ProcessEvent();
+        LSM6DSM::instance().service();
+        MMC5633NJL::instance().sample();
         if (Timeline::instance().CheckIdleReadyAndClear()) {
             i2c1::instance().update();
             i2c2::instance().update();
@@ -78,10 +89,14 @@ void Pendant::Run() {
         if (Timeline::instance().CheckEffectReadyAndClear()) {
             Timeline::instance().ProcessInterval();
             Timeline::instance().ProcessEffect();
+            ICS43434::instance().update();
+            Motion::instance().update();
             if (Timeline::instance().TopEffect().Valid()) {
                 Timeline::instance().TopEffect().Calc();
                 Timeline::instance().TopEffect().Commit();
             }
+            // Idle until the next effect frame, stream ahead
+            Player::instance().prefetch();
         }
         if (SDD1306::instance().IsDisplayOn() && 
             Timeline::instance().CheckDisplayReadyAndClear()) {
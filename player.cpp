@@ -0,0 +1,191 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./player.h"
+#include "./sdcard.h"
+#include "./timeline.h"
+#include "./color.h"
+
+#include <memory.h>
+#include <stdio.h>
+
+Player &Player::instance() {
+    static Player player;
+    if (!player.initialized) {
+        player.initialized = true;
+        player.init();
+    }
+    return player;
+}
+
+void Player::init() {
+    printf("Player initialized.\n");
+}
+
+bool Player::open(size_t _offset) {
+    stop();
+
+    if (!SDCard::instance().openDataStream(_offset) ||
+        SDCard::instance().readDataStream(reinterpret_cast<uint8_t *>(&header), sizeof(header)) != sizeof(header) ||
+        header.magic != animationMagic ||
+        header.frameN == 0 ||
+        header.fps == 0 ||
+        header.format > Linear16) {
+        printf("Player: no valid animation at %d\n", int(_offset));
+        SDCard::instance().closeDataStream();
+        failedOffset = _offset;
+        return false;
+    }
+
+    offset = _offset;
+    frameSize = Leds::ledsN * 3 * ( header.format == OKLab ? sizeof(float) : sizeof(uint16_t) );
+    active = true;
+
+    ringTail = 0;
+    ringCount = 0;
+    nextRead = 0;
+    wanted = 0;
+    underrun = 0;
+
+    // Starting is allowed to wait on the card, playing is not
+    while (ringCount < ringN && read()) { }
+
+    startTime = Timeline::SystemTime();
+    return true;
+}
+
+void Player::stop() {
+    if (!active) {
+        return;
+    }
+    if (underrun) {
+        printf("Player: %d underruns\n", int(underrun));
+    }
+    SDCard::instance().closeDataStream();
+    active = false;
+}
+
+void Player::close(size_t _offset) {
+    if (active && _offset == offset) {
+        stop();
+    }
+}
+
+// How many frames frame is behind target, wrapping at the end of the animation
+uint32_t Player::behind(uint32_t frame, uint32_t target) const {
+    return ( target + header.frameN - frame ) % header.frameN;
+}
+
+bool Player::read() {
+    size_t slot = ( ringTail + ringCount ) % ringN;
+    if (SDCard::instance().readDataStream(ring[slot].data(), frameSize) != frameSize) {
+        printf("Player: animation at %d is truncated\n", int(offset));
+        failedOffset = offset;
+        stop();
+        return false;
+    }
+    ringFrame[slot] = nextRead;
+    ringCount++;
+
+    if (++nextRead >= header.frameN) {
+        nextRead = 0;
+        SDCard::instance().seekDataStream(offset + sizeof(Header));
+    }
+    return true;
+}
+
+void Player::prefetch() {
+    if (!active || ringCount >= ringN) {
+        return;
+    }
+    // Fell too far behind, skip ahead instead of reading frames which are already late
+    if (ringCount == 0 && nextRead != wanted && behind(nextRead, wanted) < header.frameN / 2) {
+        nextRead = wanted;
+        SDCard::instance().seekDataStream(offset + sizeof(Header) + nextRead * frameSize);
+    }
+    read();
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void Player::decode(const uint8_t *frame) {
+    Leds &leds(Leds::instance());
+    for (size_t c = 0; c < Leds::ledsN; c++) {
+        if (header.format == OKLab) {
+            float v[3];
+            memcpy(v, frame, sizeof(v));
+            frame += sizeof(v);
+            leds.set(c, vector::float4(v[0], v[1], v[2], 1.0f));
+        } else {
+            uint16_t v[3];
+            memcpy(v, frame, sizeof(v));
+            frame += sizeof(v);
+            const float s = 1.0f / 65535.0f;
+            leds.set(c, vector::float4(color::lRGB2OKLAB(vector::float4(float(v[0]) * s, float(v[1]) * s, float(v[2]) * s)), 1.0f));
+        }
+    }
+}
+
+void Player::calc(size_t _offset) {
+    Leds &leds(Leds::instance());
+    double now = Timeline::SystemTime();
+
+    if (_offset == failedOffset) {
+        leds.black();
+        return;
+    }
+
+    if (!active || _offset != offset) {
+        // Two animations in one cross-fade frame, only the one already streaming plays
+        if (active && ( now - lastCalc ) < ( 0.5 / Timeline::effectRate )) {
+            for (size_t s = 0; s < Leds::sidesN; s++) {
+                Leds::fill(leds.circle(s), color::srgb8({0x00,0x00,0x00}));
+                Leds::fill(leds.bird(s), color::srgb8({0x00,0x00,0x00}));
+            }
+            return;
+        }
+        if (!open(_offset)) {
+            leds.black();
+            return;
+        }
+    }
+    lastCalc = now;
+
+    wanted = uint32_t(( now - startTime ) * double(header.fps)) % header.frameN;
+
+    // Drop frames which are late, the last one stays in case the next is not there yet
+    while (ringCount > 1 && behind(ringFrame[( ringTail + 1 ) % ringN], wanted) < header.frameN / 2) {
+        ringTail = ( ringTail + 1 ) % ringN;
+        ringCount--;
+    }
+
+    if (!active || ringCount == 0) {
+        // Do not leave whatever was drawn before on the LEDs
+        underrun++;
+        leds.black();
+        return;
+    }
+
+    if (ringFrame[ringTail] != wanted) {
+        underrun++;
+    }
+    decode(ring[ringTail].data());
+}
@@ -0,0 +1,102 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef PLAYER_H_
+#define PLAYER_H_
+
+#include "./leds.h"
+
+#include <array>
+#include <cstdint>
+
+// Plays pre-rendered LED animations streamed from data.bin.
+//
+// An animation at its offset is, all little endian:
+//   uint32_t magic ('PANM'), uint16_t frameN, uint8_t format, uint8_t fps
+//   frameN frames of Leds::ledsN LEDs in Leds::get() order, each LED either
+//   float L, a, b (OKLab) or uint16_t r, g, b (Linear16)
+//
+// The file stays open while playing. prefetch() fills a small ring buffer between
+// effect frames so calc() never waits on the SD card.
+class Player {
+public:
+    static Player &instance();
+
+    static constexpr uint32_t animationMagic = 0x4D4E4150; // 'PANM'
+
+    enum Format : uint8_t {
+        OKLab,
+        Linear16
+    };
+
+    // One frame of the animation at offset in data.bin into Leds
+    void calc(size_t offset);
+
+    // Reads ahead at most one frame, call when the effect frame is done
+    void prefetch();
+
+    // Closes the data stream if the animation at offset is the one playing,
+    // for when nothing calls calc() for it any more
+    void close(size_t offset);
+
+    // Frames which were due but not in the ring buffer yet
+    size_t underruns() const { return underrun; }
+
+private:
+    static constexpr size_t ringN = 4;
+    static constexpr size_t frameBytesMax = Leds::ledsN * 3 * sizeof(float);
+
+    struct Header {
+        uint32_t magic;
+        uint16_t frameN;
+        uint8_t format;
+        uint8_t fps;
+    };
+
+    bool open(size_t offset);
+    void stop();
+    bool read();
+    void decode(const uint8_t *frame);
+    uint32_t behind(uint32_t frame, uint32_t target) const;
+
+    Header header = { };
+    size_t offset = 0;
+    size_t failedOffset = SIZE_MAX; // not retried, the card does not change while running
+    size_t frameSize = 0;
+    bool active = false;
+
+    std::array<std::array<uint8_t, frameBytesMax>, ringN> ring;
+    std::array<uint32_t, ringN> ringFrame = { };
+    size_t ringTail = 0;
+    size_t ringCount = 0;
+    uint32_t nextRead = 0;
+    uint32_t wanted = 0;
+
+    double startTime = 0.0;
+    double lastCalc = 0.0;
+    size_t underrun = 0;
+
+    void init();
+    bool initialized = false;
+};
+
+#endif /* PLAYER_H_ */
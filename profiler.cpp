@@ -0,0 +1,167 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./profiler.h"
+#include "./timeline.h"
+
+#include <stdio.h>
+
+#ifndef USE_PROFILER
+const Profiler::Stats Profiler::none;
+#endif  // #ifndef USE_PROFILER
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    if (!profiler.initialized) {
+        profiler.initialized = true;
+        profiler.init();
+    }
+    return profiler;
+}
+
+void Profiler::init() {
+    CoreDebug->DEMCR = CoreDebug->DEMCR | CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL = DWT->CTRL | DWT_CTRL_CYCCNTENA_Msk;
+
+    printf("Profiler initialized.\n");
+}
+
+size_t Profiler::bucket(uint32_t cycles) {
+    if (cycles == 0) {
+        return 0;
+    }
+    uint32_t l = uint32_t(31 - __CLZ(cycles));
+    if (l < bucketBase) {
+        return 0;
+    }
+    size_t b = 1 + ( l - bucketBase ) * 2 + ( ( cycles >> ( l - 1 ) ) & 1 );
+    return std::min(b, bucketsN - 1);
+}
+
+uint32_t Profiler::bucketEdge(size_t bucket) {
+    if (bucket == 0) {
+        return 1U << bucketBase;
+    }
+    uint32_t l = bucketBase + uint32_t(bucket - 1) / 2;
+    return ( ( bucket - 1 ) & 1 ) ? ( 1U << ( l + 1 ) ) : ( 3U << ( l - 1 ) );
+}
+
+uint32_t Profiler::Stats::percentile(uint32_t pct) const {
+    uint32_t total = 0;
+    for (uint16_t b : buckets) {
+        total += b;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint32_t target = ( total * pct + 99 ) / 100;
+    uint32_t acc = 0;
+    for (size_t c = 0; c < bucketsN; c++) {
+        acc += buckets[c];
+        if (acc >= target) {
+            return std::min(bucketEdge(c), max);
+        }
+    }
+    return max;
+}
+
+#ifdef USE_PROFILER
+void Profiler::record(Stage stage, uint32_t cycles) {
+    if (stage == Calc) {
+        lastCalc = cycles;
+    }
+
+    Stats &s(table[effect % Model::effectCount][stage]);
+    if (s.count == 0 || cycles < s.min) {
+        s.min = cycles;
+    }
+    s.max = std::max(s.max, cycles);
+    s.sum += cycles;
+    s.count++;
+
+    size_t b = bucket(cycles);
+    if (s.buckets[b] == 0xFFFF) {
+        for (uint16_t &v : s.buckets) {
+            v /= 2;
+        }
+    }
+    s.buckets[b]++;
+
+    if (stage == Commit) {
+        record(Frame, lastCalc + cycles);
+    }
+}
+#endif  // #ifdef USE_PROFILER
+
+void Profiler::reset() {
+#ifdef USE_PROFILER
+    table = { };
+#endif  // #ifdef USE_PROFILER
+}
+
+const char *Profiler::stageName(Stage stage) {
+    switch (stage) {
+        case Calc:
+            return "calc";
+        case Commit:
+            return "comm";
+        case Prepare:
+            return "prep";
+        case Transfer:
+            return "xfer";
+        case Frame:
+            return "frm";
+        default:
+            return "?";
+    }
+}
+
+uint32_t Profiler::budget() const {
+    return uint32_t(double(SystemCoreClock) / Timeline::effectRate);
+}
+
+uint32_t Profiler::micros(uint32_t cycles) const {
+    return uint32_t( ( uint64_t(cycles) * 1000000U ) / SystemCoreClock );
+}
+
+void Profiler::dump() const {
+#ifndef USE_PROFILER
+    printf("Profiler: disabled, build with USE_PROFILER\r\n");
+#else  // #ifndef USE_PROFILER
+    printf("Profiler: frame budget %d cycles (%d us)\r\n", int(budget()), int(micros(budget())));
+    printf("fx stage        n    min    avg    max    p50    p95    p99 (us)\r\n");
+    for (uint32_t e = 0; e < Model::effectCount; e++) {
+        if (table[e][Frame].count == 0 && table[e][Calc].count == 0) {
+            continue;
+        }
+        for (size_t c = 0; c < StageCount; c++) {
+            const Stats &s(table[e][c]);
+            printf("%02d %-5s %7d %6d %6d %6d %6d %6d %6d%s\r\n",
+                int(e), stageName(Stage(c)), int(s.count),
+                int(micros(s.min)), int(micros(s.avg())), int(micros(s.max)),
+                int(micros(s.percentile(50))), int(micros(s.percentile(95))), int(micros(s.percentile(99))),
+                ( c == Frame && s.max > budget() ) ? " OVER BUDGET" : "");
+        }
+    }
+#endif  // #ifndef USE_PROFILER
+}
@@ -0,0 +1,116 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "M480.h"
+
+#include "./model.h"
+
+#include <array>
+#include <cstdint>
+
+// Without it Scope compiles to nothing and the stats table (about 13KB) is not allocated
+#define USE_PROFILER 1
+
+class Profiler {
+public:
+    static Profiler &instance();
+
+    enum Stage {
+        Calc,       // mainEffect calcFunc, including cross-fades
+        Commit,     // mainEffect commitFunc
+        Prepare,    // Leds::prepare, once per side
+        Transfer,   // Leds::transfer
+        Frame,      // Calc + Commit, what has to fit into the effect rate
+        StageCount
+    };
+
+    static constexpr size_t bucketsN = 20;
+    static constexpr uint32_t bucketBase = 11; // first bucket edge at 2^11 cycles
+
+    struct Stats {
+        uint64_t sum = 0;
+        uint32_t count = 0;
+        uint32_t min = 0;
+        uint32_t max = 0;
+        // Two buckets per octave, halved when one saturates so the shape is kept
+        std::array<uint16_t, bucketsN> buckets = { };
+
+        uint32_t avg() const { return count ? uint32_t(sum / count) : 0; }
+        uint32_t percentile(uint32_t pct) const;
+    };
+
+    static uint32_t cycles() { return DWT->CYCCNT; }
+
+    // Effect the next samples are booked to
+    void setEffect(uint32_t _effect) { effect = _effect; }
+
+#ifdef USE_PROFILER
+    void record(Stage stage, uint32_t cycles);
+    const Stats &stats(uint32_t _effect, Stage stage) const { return table[_effect % Model::effectCount][stage]; }
+#else  // #ifdef USE_PROFILER
+    void record(Stage, uint32_t) { }
+    const Stats &stats(uint32_t, Stage) const { return none; }
+#endif  // #ifdef USE_PROFILER
+    void reset();
+
+    static const char *stageName(Stage stage);
+    uint32_t budget() const;
+    uint32_t micros(uint32_t cycles) const;
+
+    // Table of all effects which have samples, over UART5
+    void dump() const;
+
+    class Scope {
+    public:
+#ifdef USE_PROFILER
+        explicit Scope(Stage _stage) : stage(_stage), start(cycles()) { }
+        ~Scope() {
+            Profiler::instance().record(stage, cycles() - start);
+        }
+    private:
+        Stage stage;
+        uint32_t start;
+#else  // #ifdef USE_PROFILER
+        explicit Scope(Stage) { }
+#endif  // #ifdef USE_PROFILER
+    };
+
+private:
+    static size_t bucket(uint32_t cycles);
+    static uint32_t bucketEdge(size_t bucket);
+
+#ifdef USE_PROFILER
+    std::array<std::array<Stats, StageCount>, Model::effectCount> table;
+#else  // #ifdef USE_PROFILER
+    static const Stats none;
+#endif  // #ifdef USE_PROFILER
+    uint32_t effect = 0;
+    uint32_t lastCalc = 0;
+
+    void init();
+    bool initialized = false;
+};
+
+#endif /* PROFILER_H_ */
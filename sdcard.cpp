@@ -355,6 +355,46 @@ bool SDCard::readFromDataFile(uint8_t* outBuf, size_t offset, size_t size) {
     return false;
 }
 
+bool SDCard::openDataStream(size_t offset) {
+    if (!datafile_present) {
+        return false;
+    }
+
+    closeDataStream();
+
+    if (f_open(&dataStream, "data.bin", FA_READ | FA_OPEN_EXISTING) != FR_OK) {
+        return false;
+    }
+    datastream_open = true;
+
+    return seekDataStream(offset);
+}
+
+bool SDCard::seekDataStream(size_t offset) {
+    if (!datastream_open) {
+        return false;
+    }
+    return f_lseek(&dataStream, offset) == FR_OK;
+}
+
+size_t SDCard::readDataStream(uint8_t *outBuf, size_t size) {
+    if (!datastream_open) {
+        return 0;
+    }
+    UINT readLen = 0;
+    if (f_read(&dataStream, outBuf, size, &readLen) != FR_OK) {
+        return 0;
+    }
+    return readLen;
+}
+
+void SDCard::closeDataStream() {
+    if (datastream_open) {
+        f_close(&dataStream);
+        datastream_open = false;
+    }
+}
+
 void SDCard::findDataFile() {
     if (!mounted) {
         return;
@@ -43,6 +43,12 @@ public:
     bool readFromDataFile(uint8_t *outBuf, size_t offset, size_t size);
     bool dataFilePresent() const { return datafile_present; }
 
+    // data.bin kept open for sequential reads, independent of readFromDataFile
+    bool openDataStream(size_t offset);
+    bool seekDataStream(size_t offset);
+    size_t readDataStream(uint8_t *outBuf, size_t size);
+    void closeDataStream();
+
     bool newFirmwareAvailable() const {  
         return firmware_bootloaded && 
                firmware_release && 
@@ -56,6 +62,9 @@ private:
 
     bool datafile_present = false;
 
+    FIL dataStream = { };
+    bool datastream_open = false;
+
     bool firmware_release = false;
     bool firmware_bootloaded = false;
 
@@ -103,35 +103,42 @@ Timeline &Timeline::instance() {
 }
 
 bool Timeline::Scheduled(Timeline::Span &span) {
-    for (Span *i = head; i ; i = i->next) {
-        if ( i == &span ) {
-            return true;
-        }
-    }
-    return false;
+    return span.scheduled;
+}
+
+void Timeline::Invalidate(Span::Type type) {
+    nextChange[type] = -std::numeric_limits<double>::infinity();
+    topValidUntil[type] = -std::numeric_limits<double>::infinity();
 }
 
 void Timeline::Add(Timeline::Span &span) {
-    for (Span *i = head; i ; i = i->next) {
-        if ( i == &span ) {
-            return;
-        }
+    // Always invalidate, callers move the time of spans which are already scheduled
+    Invalidate(span.type);
+
+    if (span.scheduled) {
+        return;
     }
 
-    span.next = head;
-    head = &span;
+    span.scheduled = true;
+    span.next = heads[span.type];
+    heads[span.type] = &span;
 }
 
 void Timeline::Remove(Timeline::Span &span) {
+    if (!span.scheduled) {
+        return;
+    }
     Span *p = 0;
-    for (Span *i = head; i ; i = i->next) {
+    for (Span *i = heads[span.type]; i ; i = i->next) {
         if ( i == &span ) {
             if (p) {
                 p->next = i->next;
             } else {
-                head = i->next;
+                heads[span.type] = i->next;
             }
             i->next = 0;
+            i->scheduled = false;
+            Invalidate(span.type);
             i->Done();
             return;
         }
@@ -140,115 +147,122 @@ void Timeline::Remove(Timeline::Span &span) {
 }
 
 void Timeline::Process(Span::Type type) {
+    double now = SystemTime();
+
+    // Nothing starts or expires before nextChange
+    if (now < nextChange[type]) {
+        return;
+    }
+    nextChange[type] = std::numeric_limits<double>::infinity();
+
     static std::array<Span *, 64> collected;
     size_t collected_num = 0;
-    double now = SystemTime();
+    double next = std::numeric_limits<double>::infinity();
     Span *p = 0;
-    for (Span *i = head; i ; i = i->next) {
-        if (i->type == type) {
-            if ((i->time) <= now && !i->active) {
-                i->active = true;
-                i->Start();
-            }
+    for (Span *i = heads[type]; i ; ) {
+        Span *n = i->next;
+        bool unlinked = false;
+        if ((i->time) <= now && !i->active) {
+            i->active = true;
+            i->Start();
+        }
+        if (i->duration != std::numeric_limits<double>::infinity() && ((i->time + i->duration) < now)) {
             switch (type) {
-                case Span::Event: {
-                    Event *event = static_cast<Event *>(i);
-                    if (event->duration != std::numeric_limits<double>::infinity() && ((event->time + event->duration) < now)) {
-                        if (p) {
-                            p->next = event->next;
-                        } else {
-                            head = event->next;
-                        }
-                        if (collected_num < collected.size()) {
-                            collected[collected_num++] = event;
-                        }
-                    }
-                } break;
-                case Span::Display: {
-                    Display *display = static_cast<Display *>(i);
-                    if (display->duration != std::numeric_limits<double>::infinity() && ((display->time + display->duration) < now)) {
-                        if (p) {
-                            p->next = display->next;
-                        } else {
-                            head = display->next;
-                        }
-                        if (collected_num < collected.size()) {
-                            collected[collected_num++] = display;
-                        }
-                    }
-                } break;
+                case Span::Event:
+                case Span::Display:
                 case Span::Effect: {
-                    Effect *effect = static_cast<Effect *>(i);
-                    if (effect->duration != std::numeric_limits<double>::infinity() && ((effect->time + effect->duration) < now)) {
-                        if (p) {
-                            p->next = effect->next;
-                        } else {
-                            head = effect->next;
-                        }
-                        if (collected_num < collected.size()) {
-                            collected[collected_num++] = effect;
-                        }
+                    if (p) {
+                        p->next = n;
+                    } else {
+                        heads[type] = n;
+                    }
+                    i->scheduled = false;
+                    unlinked = true;
+                    if (collected_num < collected.size()) {
+                        collected[collected_num++] = i;
                     }
                 } break;
                 case Span::Interval: {
                     Interval *interval = static_cast<Interval *>(i);
-                    if (interval->duration != std::numeric_limits<double>::infinity() && ((interval->time + interval->duration) < now)) {
-                        // Reschedule
-                        if (interval->intervalFuzz != 0.0) {
-                            std::uniform_real_distribution<> dis(interval->interval, interval->interval + interval->intervalFuzz);
-                            interval->time += dis(gen);
-                        } else {
-                            interval->time += interval->interval;
-                        }
-                        interval->active = false;
-                        interval->Done();
+                    // Reschedule
+                    if (interval->intervalFuzz != 0.0) {
+                        std::uniform_real_distribution<> dis(interval->interval, interval->interval + interval->intervalFuzz);
+                        interval->time += dis(gen);
+                    } else {
+                        interval->time += interval->interval;
                     }
+                    interval->active = false;
+                    interval->Done();
                 } break;
                 case Span::None: {
                 } break;
             }
         }
-        p = i;
+        if (!unlinked) {
+            next = std::min(next, i->active ? (i->time + i->duration) : i->time);
+            p = i;
+        }
+        i = n;
     }
-    switch (type) {
-        case Span::Event:
-        case Span::Display:
-        case Span::Effect: {
-            for (size_t c = 0; c < collected_num; c++) {
-                collected[c]->active = false;
-                collected[c]->next = 0;
-                collected[c]->Done();
-            }
-        } break;
-        case Span::Interval: {
-        } break;
-        case Span::None: {
-        } break;
+
+    for (size_t c = 0; c < collected_num; c++) {
+        collected[c]->active = false;
+        collected[c]->next = 0;
+        collected[c]->Done();
     }
+
+    topValidUntil[type] = -std::numeric_limits<double>::infinity();
+
+    // Callbacks above may have added or removed spans, which already invalidated
+    nextChange[type] = std::min(nextChange[type], next);
+}
+
+void Timeline::UpdateTop(Span::Type type, double time) const {
+    top[type] = nullptr;
+    below[type] = nullptr;
+    double until = std::numeric_limits<double>::infinity();
+    for (Span *i = heads[type]; i ; i = i->next) {
+        if (i->time > time) {
+            until = std::min(until, i->time);
+            continue;
+        }
+        double end = i->time + i->duration;
+        if (i->duration != std::numeric_limits<double>::infinity() && end <= time) {
+            continue;
+        }
+        until = std::min(until, end);
+        if (!top[type]) {
+            top[type] = i;
+        } else if (!below[type]) {
+            below[type] = i;
+        }
+    }
+    topValidUntil[type] = until;
 }
 
 Timeline::Span &Timeline::Top(Span::Type type) const {
     static Timeline::Span empty;
     double time = SystemTime();
-    for (Span *i = head; i ; i = i->next) {
-        if ((i->type == type) &&
-            (i->time <= time) &&
-            ( (i->duration == std::numeric_limits<double>::infinity()) || ((i->time + i->duration) > time) ) ) {
-            return *i;
-        }
+    if (!(time < topValidUntil[type])) {
+        UpdateTop(type, time);
     }
-    return empty;
+    return top[type] ? *top[type] : empty;
 }
 
 Timeline::Span &Timeline::Below(const Span *context, Span::Type type) const {
     static Timeline::Span empty;
     double time = SystemTime();
-    for (Span *i = head; i ; i = i->next) {
+    if (!(time < topValidUntil[type])) {
+        UpdateTop(type, time);
+    }
+    if (context == top[type]) {
+        return below[type] ? *below[type] : empty;
+    }
+    for (Span *i = heads[type]; i ; i = i->next) {
         if (i == context) {
             continue;
         }
-        if ((i->type == type) &&
-            (i->time <= time) &&
+        if ((i->time <= time) &&
             ( (i->duration == std::numeric_limits<double>::infinity()) || ((i->time + i->duration) > time) ) ) {
             return *i;
         }
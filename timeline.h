@@ -24,6 +24,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define TIMELINE_H_
 
 #include <cstdint>
+#include <cstddef>
 #include <functional>
 #include <tuple>
 #include <random>
@@ -84,6 +85,7 @@ public:
 
         friend class Timeline;
         bool active = false;
+        bool scheduled = false;
         Span *next = 0;
     };
 
@@ -160,8 +162,20 @@ private:
     void Process(Span::Type type);
     Span &Top(Span::Type type) const;
     Span &Below(const Span *context, Span::Type type) const;
+    void UpdateTop(Span::Type type, double time) const;
+    void Invalidate(Span::Type type);
 
-    Span *head = 0;
+    static constexpr size_t typeN = size_t(Span::Display) + 1;
+
+    // One list per span type, most recently added first
+    Span *heads[typeN] = { };
+    // Earliest pending start or expiry per type, Process() is a no-op before it
+    double nextChange[typeN] = { };
+
+    // Top() and Below(Top()) per type, valid until the next start or expiry
+    mutable Span *top[typeN] = { };
+    mutable Span *below[typeN] = { };
+    mutable double topValidUntil[typeN] = { };
 
     void init();
     bool initialized = false;
@@ -0,0 +1,242 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Runs every builtin effect for a fixed time with a fixed seed on the host, hashes each
+// frame the way Leds does for change detection and reports time per frame.
+//
+//   effectbench [--seconds N] [--seed S] [--frames] [--write FILE | --check FILE]
+//               [--times FILE | --compare FILE]
+//
+// Effects keep state in statics, so hashes are only comparable between full runs with
+// the same arguments. --check exits non zero when any effect hash differs from FILE.
+// --times saves avg ns per frame, --compare prints them next to this run with the
+// speedup. Build a before and an after tree to compare a change.
+
+#include "host.h"
+
+#include "effects.h"
+#include "leds.h"
+#include "model.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <array>
+
+static constexpr double frameRate = 120.0;
+
+struct Result {
+    uint32_t hash = 2166136261U;
+    uint32_t frames = 0;
+    uint64_t totalNs = 0;
+    uint64_t worstNs = 0;
+};
+
+static Result run(uint32_t effect, uint32_t seed, double seconds, bool dumpFrames) {
+    Result result;
+    Effects &effects(Effects::instance());
+    Leds &leds(Leds::instance());
+
+    effects.seed(seed);
+    leds.setTarget(nullptr);
+    for (size_t s = 0; s < Leds::sidesN; s++) {
+        Leds::fill(leds.circle(s), vector::float4());
+        Leds::fill(leds.bird(s), vector::float4());
+    }
+
+    hostTime = 0.0;
+    const uint32_t frames = uint32_t(seconds * frameRate);
+    for (uint32_t f = 0; f < frames; f++) {
+        hostTime = double(f) / frameRate;
+
+        auto start = std::chrono::steady_clock::now();
+        effects.calc(effect);
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        result.totalNs += ns;
+        result.worstNs = std::max(result.worstNs, ns);
+
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            uint32_t h = leds.hash(s, 1.0f);
+            if (dumpFrames) {
+                printf("%2u %5u %zu %08x\n", unsigned(effect), unsigned(f), s, unsigned(h));
+            }
+            result.hash = ( result.hash ^ h ) * 16777619U;
+        }
+        result.frames++;
+    }
+    effects.release(effect);
+    return result;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--seconds N] [--seed S] [--frames] [--write FILE | --check FILE] [--times FILE | --compare FILE]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = 10.0;
+    uint32_t seed = 0x5EED;
+    bool dumpFrames = false;
+    const char *writePath = nullptr;
+    const char *checkPath = nullptr;
+    const char *timesPath = nullptr;
+    const char *comparePath = nullptr;
+
+    for (int c = 1; c < argc; c++) {
+        if (strcmp(argv[c], "--seconds") == 0 && c + 1 < argc) {
+            seconds = atof(argv[++c]);
+        } else if (strcmp(argv[c], "--seed") == 0 && c + 1 < argc) {
+            seed = uint32_t(strtoul(argv[++c], nullptr, 0));
+        } else if (strcmp(argv[c], "--frames") == 0) {
+            dumpFrames = true;
+        } else if (strcmp(argv[c], "--write") == 0 && c + 1 < argc) {
+            writePath = argv[++c];
+        } else if (strcmp(argv[c], "--check") == 0 && c + 1 < argc) {
+            checkPath = argv[++c];
+        } else if (strcmp(argv[c], "--times") == 0 && c + 1 < argc) {
+            timesPath = argv[++c];
+        } else if (strcmp(argv[c], "--compare") == 0 && c + 1 < argc) {
+            comparePath = argv[++c];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::array<Result, Model::builtinEffectCount> results;
+    for (uint32_t e = 0; e < Model::builtinEffectCount; e++) {
+        results[e] = run(e, seed, seconds, dumpFrames);
+    }
+
+    auto avgNs = [&](uint32_t e) {
+        return results[e].frames ? results[e].totalNs / results[e].frames : 0;
+    };
+
+    // Baseline avg ns per frame from an earlier --times run, 0 where missing
+    std::array<uint64_t, Model::builtinEffectCount> baseline = { };
+    if (comparePath) {
+        FILE *file = fopen(comparePath, "r");
+        if (!file) {
+            fprintf(stderr, "Could not open %s\n", comparePath);
+            return 2;
+        }
+        char line[128];
+        while (fgets(line, sizeof(line), file)) {
+            unsigned effect = 0;
+            unsigned long long ns = 0;
+            if (line[0] == '#' || sscanf(line, "%u %llu", &effect, &ns) != 2) {
+                continue;
+            }
+            if (effect < Model::builtinEffectCount) {
+                baseline[effect] = ns;
+            }
+        }
+        fclose(file);
+    }
+
+    if (comparePath) {
+        printf("effect     hash   frames   avg ns/frame  worst ns  before ns  speedup\n");
+    } else {
+        printf("effect     hash   frames   avg ns/frame  worst ns\n");
+    }
+    uint64_t totalNs = 0;
+    uint64_t totalBefore = 0;
+    for (uint32_t e = 0; e < Model::builtinEffectCount; e++) {
+        const Result &r = results[e];
+        printf("%6u  %08x  %6u  %13llu  %8llu", unsigned(e), unsigned(r.hash), unsigned(r.frames),
+               (unsigned long long)avgNs(e), (unsigned long long)r.worstNs);
+        if (comparePath && baseline[e] && avgNs(e)) {
+            printf("  %9llu  %6.2fx", (unsigned long long)baseline[e], double(baseline[e]) / double(avgNs(e)));
+            totalNs += avgNs(e);
+            totalBefore += baseline[e];
+        }
+        printf("\n");
+    }
+    if (comparePath && totalNs) {
+        printf("   sum                    %13llu            %9llu  %6.2fx\n",
+               (unsigned long long)totalNs, (unsigned long long)totalBefore, double(totalBefore) / double(totalNs));
+    }
+
+    if (timesPath) {
+        FILE *file = fopen(timesPath, "w");
+        if (!file) {
+            fprintf(stderr, "Could not open %s\n", timesPath);
+            return 2;
+        }
+        fprintf(file, "# effectbench --seconds %g --seed 0x%x, avg ns per frame\n", seconds, unsigned(seed));
+        for (uint32_t e = 0; e < Model::builtinEffectCount; e++) {
+            fprintf(file, "%u %llu\n", unsigned(e), (unsigned long long)avgNs(e));
+        }
+        fclose(file);
+    }
+
+    if (writePath) {
+        FILE *file = fopen(writePath, "w");
+        if (!file) {
+            fprintf(stderr, "Could not open %s\n", writePath);
+            return 2;
+        }
+        fprintf(file, "# effectbench --seconds %g --seed 0x%x\n", seconds, unsigned(seed));
+        for (uint32_t e = 0; e < Model::builtinEffectCount; e++) {
+            fprintf(file, "%u %08x\n", unsigned(e), unsigned(results[e].hash));
+        }
+        fclose(file);
+    }
+
+    if (checkPath) {
+        FILE *file = fopen(checkPath, "r");
+        if (!file) {
+            fprintf(stderr, "Could not open %s\n", checkPath);
+            return 2;
+        }
+        int mismatches = 0;
+        uint32_t checked = 0;
+        char line[128];
+        while (fgets(line, sizeof(line), file)) {
+            unsigned effect = 0;
+            unsigned hash = 0;
+            if (line[0] == '#' || sscanf(line, "%u %x", &effect, &hash) != 2) {
+                continue;
+            }
+            if (effect >= Model::builtinEffectCount) {
+                continue;
+            }
+            checked++;
+            if (results[effect].hash != hash) {
+                fprintf(stderr, "Effect %u: hash %08x, expected %08x\n", effect, unsigned(results[effect].hash), hash);
+                mismatches++;
+            }
+        }
+        fclose(file);
+        if (checked != Model::builtinEffectCount) {
+            fprintf(stderr, "%s covers %u of %u effects\n", checkPath, unsigned(checked), unsigned(Model::builtinEffectCount));
+            return 1;
+        }
+        return mismatches ? 1 : 0;
+    }
+
+    return 0;
+}
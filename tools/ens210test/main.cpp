@@ -0,0 +1,177 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// ENS210 step sequencing against a mock i2c1 on the real Timeline. Every transfer is
+// logged with its time, the mock sensor reports busy for a set number of status polls.
+// Checks the reset/normal/measure writes at least 2 ms apart, the first status poll no
+// earlier than the 130 ms conversion, 10 ms polls while busy, one data read once ready, and that
+// nothing touches the bus between measurements.
+
+#include "host.h"
+#include "ens210.h"
+#include "i2cmanager.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+struct Transfer {
+    double time;
+    bool write;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<Transfer> transfers;
+static double now = 0.0;
+
+// Mock sensor, 25 C and 50 %RH in the ENS210 formats
+static size_t busyPolls = 0;
+static uint8_t lastReg = 0;
+static constexpr uint16_t temperatureRaw = 19082; // K * 64
+static constexpr uint16_t humidityRaw = 25600;    // %RH * 512
+
+i2c1 &i2c1::instance() {
+    static i2c1 i2c;
+    return i2c;
+}
+
+// Probing finds the ENS210, like checkReady() on the device
+void i2c1::update() {
+    ENS210::devicePresent = true;
+}
+
+void i2c1::write(uint8_t peripheralAddr, uint8_t data[], size_t len) {
+    transfers.push_back({ now, true, std::vector<uint8_t>(data, data + len) });
+    lastReg = data[0];
+}
+
+uint32_t i2c1::read(uint8_t peripheralAddr, uint8_t data[], size_t len) {
+    transfers.push_back({ now, false, std::vector<uint8_t>(len) });
+    if (lastReg == 0x24) {
+        data[0] = busyPolls ? 1 : 0;
+        busyPolls -= busyPolls ? 1 : 0;
+    } else if (lastReg == 0x30 && len == 6) {
+        // T_VAL then H_VAL, 16 bit data, valid bit, CRC left 0
+        data[0] = uint8_t(temperatureRaw);
+        data[1] = uint8_t(temperatureRaw >> 8);
+        data[2] = 0x01;
+        data[3] = uint8_t(humidityRaw);
+        data[4] = uint8_t(humidityRaw >> 8);
+        data[5] = 0x01;
+    }
+    return uint32_t(len);
+}
+
+static constexpr double tick = 0.00025;
+
+// Main loop: events only
+static void run(double until) {
+    while (now < until) {
+        now += tick;
+        setSystemTime(now);
+        Timeline::instance().ProcessEvent();
+    }
+}
+
+static int failed = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failed++;
+    }
+}
+
+// Transfer n is a write of bytes or a read of len, issued at least delay after the time
+// at and within two ticks of it. Each step times its delay from when it ran.
+static bool timed(size_t n, double at, double delay) {
+    double late = transfers[n].time - ( at + delay );
+    return late >= -1e-9 && late <= 2.0 * tick;
+}
+
+static void expectWrite(size_t n, std::vector<uint8_t> bytes, double at, double delay, const char *what) {
+    bool ok = n < transfers.size() && transfers[n].write && transfers[n].data == bytes && timed(n, at, delay);
+    printf("  %-34s %s at %8.2f ms\n", what, ok ? "ok" : "--", n < transfers.size() ? transfers[n].time * 1000.0 : -1.0);
+    check(ok, what);
+}
+
+static void expectRead(size_t n, size_t len, double at, const char *what) {
+    bool ok = n < transfers.size() && !transfers[n].write && transfers[n].data.size() == len && timed(n, at, 0.0);
+    printf("  %-34s %s at %8.2f ms\n", what, ok ? "ok" : "--", n < transfers.size() ? transfers[n].time * 1000.0 : -1.0);
+    check(ok, what);
+}
+
+static double at(size_t n) {
+    return n < transfers.size() ? transfers[n].time : 0.0;
+}
+
+int main() {
+    // Bring up the Timeline TIMER0 and start past its first second
+    now = 1.0;
+    setSystemTime(now);
+    Timeline::instance();
+
+    i2c1::instance().update();
+    busyPolls = 2;
+    const double start = now;
+    ENS210 &ens(ENS210::instance());
+
+    printf("init:\n");
+    run(start + 0.5);
+    // Datasheet reset and single shot conversion times, status poll period
+    const double r = 0.002;
+    const double c = 0.130;
+    const double p = 0.010;
+    expectWrite(0, { 0x10, 0x80 }, start, 0.0, "SYS_CTRL reset");
+    expectWrite(1, { 0x10, 0x00 }, at(0), r, "SYS_CTRL normal");
+    expectWrite(2, { 0x21, 0x00, 0x03 }, at(1), r, "SENS_RUN/SENS_START single");
+    expectWrite(3, { 0x24 }, at(2), c, "SENS_STAT");
+    expectRead(4, 1, at(3), "status busy");
+    expectWrite(5, { 0x24 }, at(4), p, "SENS_STAT");
+    expectRead(6, 1, at(5), "status busy");
+    expectWrite(7, { 0x24 }, at(6), p, "SENS_STAT");
+    expectRead(8, 1, at(7), "status ready");
+    expectWrite(9, { 0x30 }, at(8), 0.0, "T_VAL");
+    expectRead(10, 6, at(9), "T_VAL/H_VAL data");
+    check(transfers.size() == 11, "no transfers after the data read");
+    check(fabs(ens.Time() - at(10)) < tick, "Time() is the data read");
+    check(fabs(ens.Temperature() - 25.0f) < 0.01f, "temperature 25 C");
+    check(fabs(ens.Humidity() - 0.5f) < 0.001f, "humidity 50 %RH");
+
+    // Idle until update() asks for the next one, which is ready on the first poll
+    printf("update:\n");
+    run(now + 1.0);
+    check(transfers.size() == 11, "idle keeps off the bus");
+    ens.update();
+    ens.update();
+    const double next = now;
+    run(now + 0.5);
+    expectWrite(11, { 0x21, 0x00, 0x03 }, next, 0.0, "SENS_RUN/SENS_START single");
+    expectWrite(12, { 0x24 }, at(11), c, "SENS_STAT");
+    expectRead(13, 1, at(12), "status ready");
+    expectWrite(14, { 0x30 }, at(13), 0.0, "T_VAL");
+    expectRead(15, 6, at(14), "T_VAL/H_VAL data");
+    check(transfers.size() == 16, "a second update() in flight is ignored");
+
+    printf("%zu transfers\n", transfers.size());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Accuracy and throughput of the fastmath.h approximations against libm on the host.
+//
+//   fastmathbench [--samples N]
+//
+// Off target fastmath.h uses its bit-trick paths, the ones without the FPU instructions.
+// Each function is swept over the range the firmware feeds it, compared against the
+// double precision libm result rounded to float. Reports a ULP histogram, the largest
+// ULP and absolute error, bits of accuracy as -log2 of the largest relative error and
+// ns per call next to the libm float equivalent. The logarithms cross zero at 1, where
+// relative error means nothing, so their bits come from the largest absolute error.
+
+#include "fastmath.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <array>
+#include <bit>
+
+// Buckets of the ULP histogram: 0, 1, 2, 3-4, 5-8, ... 2^(n-2)+1 and above
+static constexpr size_t histogramN = 24;
+
+struct Stats {
+    std::array<uint64_t, histogramN> histogram = { };
+    uint64_t maxUlp = 0;
+    double maxRel = 0.0;
+    double maxAbs = 0.0;
+    float worstX = 0.0f;
+};
+
+// Floats as integers that order the same way, so ULP distance is a subtraction
+static int64_t ordered(float v) {
+    int32_t i = std::bit_cast<int32_t>(v);
+    return i < 0 ? int64_t(INT32_MIN) - int64_t(i) : int64_t(i);
+}
+
+static size_t bucket(uint64_t ulp) {
+    if (ulp <= 2) {
+        return size_t(ulp);
+    }
+    size_t b = 3;
+    for (uint64_t top = 4; ulp > top && b < histogramN - 1; top <<= 1) {
+        b++;
+    }
+    return b;
+}
+
+static void accumulate(Stats &stats, float x, float value, double reference) {
+    const float rounded = float(reference);
+    const uint64_t ulp = uint64_t(std::llabs(ordered(value) - ordered(rounded)));
+    stats.histogram[bucket(ulp)]++;
+    const double abs = std::fabs(double(value) - reference);
+    const double rel = reference != 0.0 ? abs / std::fabs(reference) : abs;
+    if (ulp > stats.maxUlp) {
+        stats.maxUlp = ulp;
+        stats.worstX = x;
+    }
+    stats.maxRel = std::max(stats.maxRel, rel);
+    stats.maxAbs = std::max(stats.maxAbs, abs);
+}
+
+// Log uniform over [lo, hi) when both are positive, uniform otherwise
+static std::vector<float> inputs(size_t n, float lo, float hi, uint32_t seed) {
+    std::mt19937 gen(seed);
+    std::vector<float> v(n);
+    if (lo > 0.0f) {
+        std::uniform_real_distribution<double> dis(std::log(double(lo)), std::log(double(hi)));
+        for (float &x : v) {
+            x = float(std::exp(dis(gen)));
+        }
+    } else {
+        std::uniform_real_distribution<double> dis(static_cast<double>(lo), static_cast<double>(hi));
+        for (float &x : v) {
+            x = float(dis(gen));
+        }
+    }
+    return v;
+}
+
+template<class F> static double nsPerCall(const std::vector<float> &x, const F &func) {
+    volatile float sink = 0.0f;
+    float sum = 0.0f;
+    double best = 1e30;
+    // Best of a few passes, the first one warms the caches
+    for (size_t pass = 0; pass < 5; pass++) {
+        auto start = std::chrono::steady_clock::now();
+        for (float v : x) {
+            sum += func(v);
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) / double(x.size()));
+    }
+    sink = sum;
+    (void)sink;
+    return best;
+}
+
+static void header() {
+    printf("%-14s %-18s %7s %10s %11s %7s %8s %8s  ulp histogram 0 1 2 3-4 5-8 ...\n",
+           "function", "range", "bits", "max ulp", "max abs", "at", "ns", "libm ns");
+}
+
+template<class F, class R, class L>
+static void sweep(const char *name, float lo, float hi, size_t n, bool absolute, const F &fast, const R &reference, const L &libm) {
+    std::vector<float> x(inputs(n, lo, hi, 0x5EED));
+    Stats stats;
+    for (float v : x) {
+        accumulate(stats, v, fast(v), reference(double(v)));
+    }
+    const double fastNs = nsPerCall(x, fast);
+    const double libmNs = nsPerCall(x, libm);
+
+    char range[32];
+    snprintf(range, sizeof(range), "[%g, %g)", double(lo), double(hi));
+    const double maxErr = absolute ? stats.maxAbs : stats.maxRel;
+    printf("%-14s %-18s %7.2f %10llu %11.3g %7.3g %8.2f %8.2f ", name, range,
+           maxErr > 0.0 ? -std::log2(maxErr) : 64.0, (unsigned long long)stats.maxUlp,
+           stats.maxAbs, double(stats.worstX), fastNs, libmNs);
+    for (uint64_t count : stats.histogram) {
+        printf(" %llu", (unsigned long long)count);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    size_t samples = 1 << 20;
+
+    for (int c = 1; c < argc; c++) {
+        if (strcmp(argv[c], "--samples") == 0 && c + 1 < argc) {
+            samples = size_t(strtoull(argv[++c], nullptr, 0));
+        } else {
+            fprintf(stderr, "usage: %s [--samples N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    header();
+
+    sweep("fast_rcp", 1e-6f, 1e6f, samples, false,
+          [](float x) { return fast_rcp(x); },
+          [](double x) { return 1.0 / x; },
+          [](float x) { return 1.0f / x; });
+    sweep("fast_sqrtf", 1e-6f, 1e6f, samples, false,
+          [](float x) { return fast_sqrtf(x); },
+          [](double x) { return std::sqrt(x); },
+          [](float x) { return std::sqrt(x); });
+    sweep("fast_rsqrtf", 1e-6f, 1e6f, samples, false,
+          [](float x) { return fast_rsqrtf(x); },
+          [](double x) { return 1.0 / std::sqrt(x); },
+          [](float x) { return 1.0f / std::sqrt(x); });
+    sweep("fast_cbrtf", 1e-6f, 8.0f, samples, false,
+          [](float x) { return fast_cbrtf(x); },
+          [](double x) { return std::cbrt(x); },
+          [](float x) { return std::cbrt(x); });
+    sweep("fast_rcbrtf", 1e-6f, 8.0f, samples, false,
+          [](float x) { return fast_rcbrtf(x); },
+          [](double x) { return 1.0 / std::cbrt(x); },
+          [](float x) { return 1.0f / std::cbrt(x); });
+    sweep("fast_exp2", -20.0f, 20.0f, samples, false,
+          [](float x) { return fast_exp2(x); },
+          [](double x) { return std::exp2(x); },
+          [](float x) { return std::exp2(x); });
+    sweep("fast_log2", 1e-6f, 1e6f, samples, true,
+          [](float x) { return fast_log2(x); },
+          [](double x) { return std::log2(x); },
+          [](float x) { return std::log2(x); });
+    sweep("fast_log", 1e-6f, 1e6f, samples, true,
+          [](float x) { return fast_log(x); },
+          [](double x) { return std::log(x); },
+          [](float x) { return std::log(x); });
+    // sRGB encode in color.cpp
+    sweep("fast_pow 1/2.4", 0.0031308f, 1.0f, samples, false,
+          [](float x) { return fast_pow(x, 1.0f / 2.4f); },
+          [](double x) { return std::pow(x, double(1.0f / 2.4f)); },
+          [](float x) { return std::pow(x, 1.0f / 2.4f); });
+
+    return 0;
+}
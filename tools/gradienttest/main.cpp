@@ -0,0 +1,201 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// color::gradient sampled from its stops against the 256 entry table it replaced.
+//
+// The table linearly interpolated the gradient at 255 even steps, so it only differed
+// where a cell holds a stop: across a kink in slope s0 to s1 the chord misses by at most
+// |s1 - s0| / (4 * 255). The tolerance per gradient is that bound summed over its stops,
+// plus 1e-5 for float rounding. Only the table was off, the stops are exact.
+
+#include "color.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// The table gradient as it was before stops were evaluated directly
+class table_gradient {
+public:
+    explicit table_gradient(const std::vector<vector::float4> &stops) {
+        const size_t N = stops.size();
+        for (size_t c = 0; c < colors_n; c++) {
+            float f = static_cast<float>(c) / static_cast<float>(colors_n - 1);
+            vector::float4 a = stops[0];
+            vector::float4 b = stops[1];
+            if (N > 2) {
+                for (int32_t d = static_cast<int32_t>(N-2); d >= 0 ; d--) {
+                    if ( f >= (stops[size_t(d)].w) ) {
+                        a = stops[size_t(d)+0];
+                        b = stops[size_t(d)+1];
+                        break;
+                    }
+                }
+            }
+            f -= a.w;
+            f /= b.w - a.w;
+            colors[c] = a.lerp(b,f);
+        }
+    }
+
+    vector::float4 repeat(float i) const {
+        i = fabsf(i);
+        i -= truncf(i);
+        return lookup(i);
+    }
+
+    vector::float4 reflect(float i) const {
+        i = fabsf(i);
+        if ((static_cast<int32_t>(i) & 1) == 0) {
+            i -= truncf(i);
+        } else {
+            i -= truncf(i);
+            i = 1.0f - i;
+        }
+        return lookup(i);
+    }
+
+    vector::float4 clamp(float i) const {
+        if (i <= 0.0f) {
+            return colors[0];
+        }
+        if (i >= 1.0f) {
+            return colors[colors_n-1];
+        }
+        return lookup(i);
+    }
+
+private:
+    vector::float4 lookup(float i) const {
+        i *= colors_mul;
+        return vector::float4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], i - truncf(i));
+    }
+
+    static constexpr size_t colors_n = 256;
+    static constexpr float colors_mul = 255.0;
+    static constexpr size_t colors_mask = 0xFF;
+
+    vector::float4 colors[colors_n];
+};
+
+static float tolerance(const std::vector<vector::float4> &stops) {
+    float bound = 0.0f;
+    for (size_t c = 1; c + 1 < stops.size(); c++) {
+        vector::float4 s0 = ( stops[c] - stops[c-1] ) / ( stops[c].w - stops[c-1].w );
+        vector::float4 s1 = ( stops[c+1] - stops[c] ) / ( stops[c+1].w - stops[c].w );
+        bound += std::max({ fabsf(s1.x - s0.x), fabsf(s1.y - s0.y), fabsf(s1.z - s0.z) });
+    }
+    return bound / ( 4.0f * 255.0f ) + 1e-5f;
+}
+
+static float error(const vector::float4 &a, const vector::float4 &b) {
+    return std::max({ fabsf(a.x - b.x), fabsf(a.y - b.y), fabsf(a.z - b.z) });
+}
+
+struct Case {
+    const char *name;
+    std::vector<vector::float4> stops;
+};
+
+int main() {
+    // The shapes the effects use: rainbow, uneven stops, two stop ramps
+    const std::vector<Case> cases = {
+        { "rainbow", {
+            color::srgb8_stop({0xff,0x00,0x00}, 0.00f),
+            color::srgb8_stop({0xff,0xff,0x00}, 0.16f),
+            color::srgb8_stop({0x00,0xff,0x00}, 0.33f),
+            color::srgb8_stop({0x00,0xff,0xff}, 0.50f),
+            color::srgb8_stop({0x00,0x00,0xff}, 0.66f),
+            color::srgb8_stop({0xff,0x00,0xff}, 0.83f),
+            color::srgb8_stop({0xff,0x00,0x00}, 1.00f) } },
+        { "uneven", {
+            color::srgb8_stop(0x968b3f, 0.00f),
+            color::srgb8_stop(0x097916, 0.20f),
+            color::srgb8_stop(0x00d4ff, 0.40f),
+            color::srgb8_stop(0xffffff, 0.50f),
+            color::srgb8_stop(0x8a0e45, 0.80f),
+            color::srgb8_stop(0x968b3f, 1.00f) } },
+        { "three", {
+            color::srgb8_stop(0xffffff, 0.00f),
+            color::srgb8_stop(0xff8000, 0.40f),
+            color::srgb8_stop(0x000000, 1.00f) } },
+        { "ramp", {
+            color::srgb8_stop(0x000000, 0.00f),
+            color::srgb8_stop(0x40ff80, 1.00f) } },
+        { "narrow", {
+            color::srgb8_stop(0x000000, 0.00f),
+            color::srgb8_stop(0x000000, 0.49f),
+            color::srgb8_stop(0xffffff, 0.51f),
+            color::srgb8_stop(0xffffff, 1.00f) } },
+    };
+
+    static constexpr size_t samplesN = 60000;
+    static constexpr float range = 3.0f;
+
+    int failed = 0;
+    printf("gradient   tolerance     repeat    reflect      clamp  repeat[]  reflect[]\n");
+    for (const Case &test : cases) {
+        color::gradient g(test.stops);
+        table_gradient t(test.stops);
+
+        float repeatErr = 0.0f;
+        float reflectErr = 0.0f;
+        float clampErr = 0.0f;
+        for (size_t c = 0; c <= samplesN; c++) {
+            float i = -range + 2.0f * range * float(c) / float(samplesN);
+            repeatErr = std::max(repeatErr, error(g.repeat(i), t.repeat(i)));
+            reflectErr = std::max(reflectErr, error(g.reflect(i), t.reflect(i)));
+            clampErr = std::max(clampErr, error(g.clamp(i), t.clamp(i)));
+        }
+
+        // The span versions step in Q32, positions are taken modulo 1 (2 for reflect)
+        static constexpr float phase = 0.173f;
+        static constexpr float step = 1.0f / 97.0f;
+        std::vector<vector::float4> out(samplesN / 10);
+        float repeatSpanErr = 0.0f;
+        g.repeat(out, phase, step);
+        for (size_t c = 0; c < out.size(); c++) {
+            float i = phase + step * float(c);
+            repeatSpanErr = std::max(repeatSpanErr, error(out[c], t.repeat(i - floorf(i))));
+        }
+        float reflectSpanErr = 0.0f;
+        g.reflect(out, phase, step);
+        for (size_t c = 0; c < out.size(); c++) {
+            float i = phase + step * float(c);
+            reflectSpanErr = std::max(reflectSpanErr, error(out[c], t.reflect(i - 2.0f * floorf(i * 0.5f))));
+        }
+
+        const float bound = tolerance(test.stops);
+        printf("%-8s  %10.6f %10.6f %10.6f %10.6f %9.6f %10.6f\n", test.name, double(bound),
+            double(repeatErr), double(reflectErr), double(clampErr), double(repeatSpanErr), double(reflectSpanErr));
+        for (float e : { repeatErr, reflectErr, clampErr, repeatSpanErr, reflectSpanErr }) {
+            if (e > bound) {
+                fprintf(stderr, "%s: error %f over tolerance %f\n", test.name, double(e), double(bound));
+                failed++;
+                break;
+            }
+        }
+    }
+
+    return failed ? 1 : 0;
+}
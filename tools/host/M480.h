@@ -0,0 +1,140 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef M480_H_HOST_
+#define M480_H_HOST_
+
+// Host stand-in for the bits of the M480 device header and CMSIS the firmware sources
+// use outside of drivers. Only enough to build effects, color, VM and Timeline code off target.
+
+#include <cstdint>
+#include <cstdio>
+
+#define __FPU_PRESENT 1
+#define __FPU_USED 1
+
+struct DWT_Type {
+    uint32_t CYCCNT;
+};
+
+inline DWT_Type hostDWT = { };
+#define DWT (&hostDWT)
+
+inline uint32_t SystemCoreClock = 192000000;
+
+static inline void __disable_irq() {
+}
+
+static inline void __enable_irq() {
+}
+
+typedef enum {
+    TMR0_IRQn,
+    TMR1_IRQn
+} IRQn_Type;
+
+static inline void NVIC_SetPriority(IRQn_Type, uint32_t) {
+}
+
+static inline void NVIC_EnableIRQ(IRQn_Type) {
+}
+
+// TIMER0 is the Timeline::SystemTime() clock, see setSystemTime() in host.h
+struct TIMER_T {
+    uint32_t CNT;
+    uint32_t CMP;
+    uint32_t INTSTS;
+};
+
+inline TIMER_T hostTIMER0 = { 0, 1000000, 0 };
+inline TIMER_T hostTIMER1 = { 0, 1000000, 0 };
+#define TIMER0 (&hostTIMER0)
+#define TIMER1 (&hostTIMER1)
+
+#define TIMER_PERIODIC_MODE 0
+
+static inline uint32_t TIMER_Open(TIMER_T *, uint32_t, uint32_t) {
+    return 0;
+}
+
+static inline void TIMER_EnableInt(TIMER_T *) {
+}
+
+static inline void TIMER_Start(TIMER_T *) {
+}
+
+static inline uint32_t TIMER_GetIntFlag(TIMER_T *timer) {
+    return timer->INTSTS;
+}
+
+static inline void TIMER_ClearIntFlag(TIMER_T *timer) {
+    timer->INTSTS = 0;
+}
+
+static inline constexpr int32_t __builtin_arm_usat(int32_t v, uint32_t b) {
+    const int32_t m = int32_t((1UL << b) - 1);
+    return v < 0 ? 0 : ( v > m ? m : v );
+}
+
+static inline constexpr int32_t __builtin_arm_ssat(int32_t v, uint32_t b) {
+    const int32_t m = int32_t(1UL << (b - 1));
+    return v < -m ? -m : ( v > m - 1 ? m - 1 : v );
+}
+
+static inline constexpr uint32_t __SSAT(uint32_t v, uint32_t b) {
+    return uint32_t(__builtin_arm_ssat(int32_t(v), b));
+}
+
+static inline uint32_t __QADD16(uint32_t a, uint32_t b) {
+    const int32_t lo = __builtin_arm_ssat(int32_t(int16_t(a)) + int32_t(int16_t(b)), 16);
+    const int32_t hi = __builtin_arm_ssat(int32_t(int16_t(a >> 16)) + int32_t(int16_t(b >> 16)), 16);
+    return ( uint32_t(lo) & 0x0000FFFFUL ) | ( uint32_t(hi) << 16 );
+}
+
+static inline uint32_t __SMUAD(uint32_t a, uint32_t b) {
+    return uint32_t(int32_t(int16_t(a)) * int32_t(int16_t(b)) +
+                    int32_t(int16_t(a >> 16)) * int32_t(int16_t(b >> 16)));
+}
+
+static inline uint32_t __SMUADX(uint32_t a, uint32_t b) {
+    return uint32_t(int32_t(int16_t(a)) * int32_t(int16_t(b >> 16)) +
+                    int32_t(int16_t(a >> 16)) * int32_t(int16_t(b)));
+}
+
+static inline uint32_t __PKHTB(uint32_t a, uint32_t b, uint32_t s) {
+    return ( a & 0xFFFF0000UL ) | ( ( b >> s ) & 0x0000FFFFUL );
+}
+
+static inline uint32_t __PKHBT(uint32_t a, uint32_t b, uint32_t s) {
+    return ( a & 0x0000FFFFUL ) | ( ( b << s ) & 0xFFFF0000UL );
+}
+
+static inline uint32_t __SMLAD(uint32_t a, uint32_t b, uint32_t c) {
+    return uint32_t(int32_t(int16_t(a)) * int32_t(int16_t(b)) +
+                    int32_t(int16_t(a >> 16)) * int32_t(int16_t(b >> 16)) + int32_t(c));
+}
+
+static inline uint32_t __CLZ(uint32_t v) {
+    return v ? uint32_t(__builtin_clz(v)) : 32;
+}
+
+#endif  // #ifndef M480_H_HOST_
@@ -0,0 +1,49 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Stub SDCard, no card and so no data.bin. VM has no programs and Player no animations.
+
+#include "sdcard.h"
+
+SDCard &SDCard::instance() {
+    static SDCard sdcard;
+    return sdcard;
+}
+
+bool SDCard::readFromDataFile(uint8_t *, size_t, size_t) {
+    return false;
+}
+
+bool SDCard::openDataStream(size_t) {
+    return false;
+}
+
+bool SDCard::seekDataStream(size_t) {
+    return false;
+}
+
+size_t SDCard::readDataStream(uint8_t *, size_t) {
+    return 0;
+}
+
+void SDCard::closeDataStream() {
+}
@@ -0,0 +1,41 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// TIMER0 for the firmware timeline.cpp, which counts seconds in its interrupt handler.
+
+#include "host.h"
+
+#include "M480.h"
+
+#include <cmath>
+
+extern "C" void TMR0_IRQHandler(void);
+
+void setSystemTime(double time) {
+    static uint32_t seconds = 0;
+    while (double(seconds) + 1.0 <= time) {
+        TIMER0->INTSTS = 1;
+        TMR0_IRQHandler();
+        seconds++;
+    }
+    TIMER0->CNT = uint32_t(( time - std::floor(time) ) * double(TIMER0->CMP));
+}
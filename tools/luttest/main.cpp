@@ -0,0 +1,91 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Leds::lut_table byte order. 8-bit SPI sends the DMA buffer byte by byte in memory
+// order, 32-bit SPI sends each word MSB first. Both must put the same bytes on the wire,
+// and those bytes must encode the component MSB first, 1000 for a 0 bit and 1100 for a 1.
+
+#include "leds.h"
+
+#include <cstdio>
+#include <vector>
+
+static constexpr Leds::lut_table<false> lut8;
+static constexpr Leds::lut_table<true> lut32;
+
+// What SPI shifts out for the DMA buffer words in 8-bit mode, little endian memory
+static void wire8(std::vector<uint8_t> &wire, uint32_t word) {
+    for (uint32_t c = 0; c < 4; c++) {
+        wire.push_back(uint8_t(word >> (c * 8)));
+    }
+}
+
+// Same in 32-bit mode, the SPI shift register sends bit 31 first
+static void wire32(std::vector<uint8_t> &wire, uint32_t word) {
+    for (uint32_t c = 0; c < 4; c++) {
+        wire.push_back(uint8_t(word >> (24 - c * 8)));
+    }
+}
+
+// Encodes one 16-bit component like Leds::encode, high byte first
+template<class T> static std::vector<uint8_t> encode(const T &lut, uint16_t v, void (*wire)(std::vector<uint8_t> &, uint32_t)) {
+    std::vector<uint8_t> bytes;
+    wire(bytes, lut[(v>>8)&0xFF]);
+    wire(bytes, lut[(v>>0)&0xFF]);
+    return bytes;
+}
+
+// Back to the value from the wire, -1 on a nibble which is neither 1000 nor 1100
+static int32_t decode(const std::vector<uint8_t> &bytes) {
+    int32_t v = 0;
+    for (uint8_t byte : bytes) {
+        for (uint32_t nibble : { uint32_t(byte >> 4), uint32_t(byte & 0xF) }) {
+            if (nibble != 0x8 && nibble != 0xC) {
+                return -1;
+            }
+            v = ( v << 1 ) | ( nibble == 0xC ? 1 : 0 );
+        }
+    }
+    return v;
+}
+
+int main() {
+    int failed = 0;
+    for (uint32_t v = 0; v < 65536; v++) {
+        std::vector<uint8_t> bytes8 = encode(lut8, uint16_t(v), wire8);
+        std::vector<uint8_t> bytes32 = encode(lut32, uint16_t(v), wire32);
+        if (bytes8 != bytes32) {
+            if (failed++ < 8) {
+                fprintf(stderr, "0x%04x: 32-bit wire bytes differ from 8-bit mode\n", v);
+            }
+            continue;
+        }
+        int32_t decoded = decode(bytes8);
+        if (decoded != int32_t(v)) {
+            if (failed++ < 8) {
+                fprintf(stderr, "0x%04x: wire decodes to 0x%04x\n", v, decoded);
+            }
+        }
+    }
+    printf("luttest: 65536 values, %d mismatches\n", failed);
+    return failed ? 1 : 0;
+}
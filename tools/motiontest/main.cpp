@@ -0,0 +1,250 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Motion replay. Synthetic LSM6DSM and MMC5633NJL logs from a known orientation are fed
+// through the real Madgwick filter in motion.cpp at the firmware rates, 208 Hz IMU and
+// 60 Hz effect frames, with noise and gyro bias. Checks that yaw and gravity converge
+// from a wrong start, that rotations are tracked, and how far a still device drifts.
+
+#include "host.h"
+#include "motion.h"
+#include "lsm6dsm.h"
+#include "mmc5633njl.h"
+
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <numbers>
+#include <random>
+
+static constexpr float pi = float(std::numbers::pi);
+static constexpr float degToRad = pi / 180.0f;
+static constexpr float imuRate = 208.0f;
+static constexpr double frameRate = 60.0;
+
+// Earth field, x north and z up, 60 degrees inclination
+static const vector::float4 earthField(0.5f, 0.0f, -0.866f);
+
+// The sensors are friends of i2c1, which is how the replay reaches their state
+class i2c1 {
+public:
+    static void setRate(float hz) { LSM6DSM::instance().odrHz = hz; }
+    static void setMag(bool present, double time) {
+        MMC5633NJL::devicePresent = present;
+        MMC5633NJL::instance().sampleTime = time;
+    }
+};
+
+static std::deque<LSM6DSM::Sample> imuLog;
+static vector::float4 magField;
+
+LSM6DSM &LSM6DSM::instance() {
+    static LSM6DSM imu;
+    return imu;
+}
+
+bool LSM6DSM::pop(Sample &sample) {
+    if (imuLog.empty() || imuLog.front().time > hostTime) {
+        return false;
+    }
+    sample = imuLog.front();
+    imuLog.pop_front();
+    return true;
+}
+
+bool MMC5633NJL::devicePresent = false;
+
+MMC5633NJL &MMC5633NJL::instance() {
+    static MMC5633NJL mag;
+    return mag;
+}
+
+float MMC5633NJL::X() const { return magField.x; }
+float MMC5633NJL::Y() const { return magField.y; }
+float MMC5633NJL::Z() const { return magField.z; }
+
+// Quaternions as x y z w like Motion::Quaternion(), device to earth
+static vector::float4 qmul(const vector::float4 &a, const vector::float4 &b) {
+    return vector::float4(
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+static vector::float4 qaxis(float x, float y, float z, float angle) {
+    float s = sinf(angle * 0.5f);
+    return vector::float4(x * s, y * s, z * s, cosf(angle * 0.5f));
+}
+
+// Earth vector into the device frame
+static vector::float4 toDevice(const vector::float4 &q, const vector::float4 &v) {
+    vector::float4 c(-q.x, -q.y, -q.z, q.w);
+    vector::float4 r(qmul(qmul(c, vector::float4(v.x, v.y, v.z, 0.0f)), q));
+    return vector::float4(r.x, r.y, r.z, 0.0f);
+}
+
+// Angle between two orientations in degrees
+static float angleDeg(const vector::float4 &a, const vector::float4 &b) {
+    float d = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+    return 2.0f * acosf(std::min(d, 1.0f)) / degToRad;
+}
+
+static float yawDeg(const vector::float4 &q) {
+    return atan2f(2.0f * (q.x * q.y + q.w * q.z), q.w * q.w + q.x * q.x - q.y * q.y - q.z * q.z) / degToRad;
+}
+
+static float wrapDeg(float a) {
+    return remainderf(a, 360.0f);
+}
+
+struct Noise {
+    float gyro = 0.1f;     // dps
+    float accel = 0.005f;  // g
+    float mag = 0.01f;     // normalized field
+    vector::float4 bias;   // dps
+};
+
+// Replays a device at orientation truth(t) with angular rate rate(t) in earth frame
+// rad/s. Calls check(t, truth) once per effect frame after Motion::update().
+template<class T, class R, class C> static void replay(double seconds, bool mag, const Noise &noise, const T &truth, const R &rate, const C &check) {
+    static std::mt19937 gen(0x1ED5);
+    std::normal_distribution<float> n(0.0f, 1.0f);
+
+    i2c1::setRate(imuRate);
+    double t = hostTime;
+    double end = hostTime + seconds;
+    double nextImu = t;
+    while (t < end) {
+        t += 1.0 / frameRate;
+        for (; nextImu <= t; nextImu += 1.0 / double(imuRate)) {
+            vector::float4 q(truth(nextImu));
+            vector::float4 a(toDevice(q, vector::float4(0.0f, 0.0f, 1.0f)));
+            vector::float4 w(toDevice(q, rate(nextImu)));
+            LSM6DSM::Sample s;
+            s.time = nextImu;
+            s.xg = w.x / degToRad + noise.bias.x + noise.gyro * n(gen);
+            s.yg = w.y / degToRad + noise.bias.y + noise.gyro * n(gen);
+            s.zg = w.z / degToRad + noise.bias.z + noise.gyro * n(gen);
+            s.xa = a.x + noise.accel * n(gen);
+            s.ya = a.y + noise.accel * n(gen);
+            s.za = a.z + noise.accel * n(gen);
+            imuLog.push_back(s);
+        }
+        hostTime = t;
+        vector::float4 m(toDevice(truth(t), earthField));
+        magField = vector::float4(m.x + noise.mag * n(gen), m.y + noise.mag * n(gen), m.z + noise.mag * n(gen));
+        i2c1::setMag(mag, t);
+        Motion::instance().update();
+        check(t - (end - seconds), truth(t));
+    }
+}
+
+static int failed = 0;
+
+static void expect(bool ok, const char *what, float value, float bound) {
+    printf("  %-48s %8.3f  (bound %.3f)\n", what, double(value), double(bound));
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s %f, bound %f\n", what, double(value), double(bound));
+        failed++;
+    }
+}
+
+static float gravityErr(const vector::float4 &truth) {
+    vector::float4 g(Motion::instance().Gravity());
+    vector::float4 e(toDevice(truth, vector::float4(0.0f, 0.0f, -1.0f)));
+    return acosf(std::clamp(g.x * e.x + g.y * e.y + g.z * e.z, -1.0f, 1.0f)) / degToRad;
+}
+
+int main() {
+    Motion &motion(Motion::instance());
+    const Noise noise;
+    const vector::float4 still;
+
+    // Filter starts at identity, the device sits yawed 60 degrees and rolled 20. The
+    // correction turns at most beta rad/s, 5.7 dps at the default 0.1, so 63 degrees
+    // take 11 s at best.
+    {
+        printf("convergence from identity, yaw 60 roll 20:\n");
+        const vector::float4 q(qmul(qaxis(0, 0, 1, 60.0f * degToRad), qaxis(1, 0, 0, 20.0f * degToRad)));
+        float settled = -1.0f;
+        replay(20.0, true, noise, [&](double) { return q; }, [&](double) { return still; }, [&](double t, const vector::float4 &truth) {
+            if (settled < 0.0f && angleDeg(motion.Quaternion(), truth) < 2.0f) {
+                settled = float(t);
+            }
+            if (settled >= 0.0f && angleDeg(motion.Quaternion(), truth) >= 2.0f) {
+                settled = -1.0f;
+            }
+        });
+        expect(settled >= 0.0f && settled < 20.0f, "settled within 2 degrees after s", settled, 20.0f);
+        float yawErr = fabsf(wrapDeg(motion.Yaw() / degToRad - 60.0f));
+        expect(yawErr < 2.0f, "yaw error at 20 s, degrees", yawErr, 2.0f);
+        float gErr = gravityErr(q);
+        expect(gErr < 0.5f, "gravity error at 20 s, degrees", gErr, 0.5f);
+    }
+
+    // Turning at 45 dps around earth z for 8 s, then still for 2 s
+    {
+        printf("yaw rotation 45 dps:\n");
+        const vector::float4 base(motion.Quaternion());
+        const float start = yawDeg(base);
+        const float w = 45.0f * degToRad;
+        auto angle = [=](double t) { return float(std::min(t, 8.0)) * w; };
+        double t0 = hostTime;
+        float worst = 0.0f;
+        replay(10.0, true, noise, [&](double t) { return qmul(qaxis(0, 0, 1, angle(t - t0)), base); },
+            [&](double t) { return (t - t0) < 8.0 ? vector::float4(0, 0, w) : still; },
+            [&](double, const vector::float4 &truth) { worst = std::max(worst, angleDeg(motion.Quaternion(), truth)); });
+        expect(worst < 3.0f, "worst orientation error while turning, degrees", worst, 3.0f);
+        float yawErr = fabsf(wrapDeg(motion.Yaw() / degToRad - (start + 360.0f)));
+        expect(yawErr < 1.0f, "yaw error after a full turn, degrees", yawErr, 1.0f);
+    }
+
+    // Still with 0.5 dps gyro bias on every axis: the accelerometer and magnetometer hold
+    // the orientation, offset by the bias against beta
+    const Noise biased = { noise.gyro, noise.accel, noise.mag, vector::float4(0.5f, 0.5f, 0.5f) };
+    {
+        printf("still, 0.5 dps gyro bias, magnetometer:\n");
+        const vector::float4 q(motion.Quaternion());
+        float worst = 0.0f;
+        replay(60.0, true, biased, [&](double) { return q; }, [&](double) { return still; },
+            [&](double, const vector::float4 &truth) { worst = std::max(worst, angleDeg(motion.Quaternion(), truth)); });
+        expect(worst < 4.0f, "worst orientation error over 60 s, degrees", worst, 4.0f);
+    }
+
+    // Same without a magnetometer: gravity still holds, yaw drifts with the bias only
+    {
+        printf("still, 0.5 dps gyro bias, no magnetometer:\n");
+        const vector::float4 q(motion.Quaternion());
+        const float start = motion.Yaw() / degToRad;
+        float worstG = 0.0f;
+        replay(60.0, false, biased, [&](double) { return q; }, [&](double) { return still; },
+            [&](double, const vector::float4 &truth) { worstG = std::max(worstG, gravityErr(truth)); });
+        expect(worstG < 0.5f, "worst gravity error over 60 s, degrees", worstG, 0.5f);
+        float drift = fabsf(wrapDeg(motion.Yaw() / degToRad - start));
+        // Never more than the whole bias integrated, 0.87 dps for 60 s
+        expect(drift < 52.0f, "yaw drift over 60 s, degrees", drift, 52.0f);
+    }
+
+    printf("%u samples\n", unsigned(motion.Samples()));
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks vector::q15x4 and the Q15 compositor blends against float math on the host.
+// Exits non zero when any result is further off than the Q15 and Q14 rounding allows.
+
+#include "compositor.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Inputs round to 2^-15, weights to 2^-15, results truncate to 2^-14
+static constexpr float tolerance = 4.0f / 32768.0f;
+
+static float maxError(const vector::float4 &a, const vector::float4 &b) {
+    return std::max(std::max(std::fabs(a.x - b.x), std::fabs(a.y - b.y)),
+                    std::max(std::fabs(a.z - b.z), std::fabs(a.w - b.w)));
+}
+
+static vector::float4 saturate(const vector::float4 &v) {
+    auto s = [](float f) { return std::clamp(f, -1.0f, 32767.0f / 32768.0f); };
+    return vector::float4(s(v.x), s(v.y), s(v.z), s(v.w));
+}
+
+static int check(const char *name, float error) {
+    printf("%-16s max error %.3g (%.2f LSB)\n", name, double(error), double(error * 32768.0f));
+    if (error > tolerance) {
+        fprintf(stderr, "%s: max error %g over tolerance %g\n", name, double(error), double(tolerance));
+        return 1;
+    }
+    return 0;
+}
+
+int main() {
+    std::mt19937 gen(0x5EED);
+    // OKLab ranges, L in [0, 1], a and b well inside [-0.5, 0.5], alpha in [0, 1]
+    std::uniform_real_distribution<float> disL(0.0f, 1.0f);
+    std::uniform_real_distribution<float> disAB(-0.5f, 0.5f);
+    std::uniform_real_distribution<float> disV(0.0f, 1.0f);
+
+    const size_t n = 1 << 16;
+    std::vector<vector::float4> dst(n);
+    std::vector<vector::float4> src(n);
+    for (size_t c = 0; c < n; c++) {
+        dst[c] = vector::float4(disL(gen), disAB(gen), disAB(gen), disV(gen));
+        src[c] = vector::float4(disL(gen), disAB(gen), disAB(gen), disV(gen));
+    }
+
+    int failed = 0;
+
+    float roundtrip = 0.0f;
+    for (size_t c = 0; c < n; c++) {
+        roundtrip = std::max(roundtrip, maxError(vector::q15x4(src[c]).to_float4(), saturate(src[c])));
+    }
+    failed += check("roundtrip", roundtrip);
+
+    // Ends of the weight range are exact
+    float ends = 0.0f;
+    for (size_t c = 0; c < n; c++) {
+        vector::q15x4 a(dst[c]);
+        vector::q15x4 b(src[c]);
+        ends = std::max(ends, maxError(vector::q15x4::lerp(a, b, vector::q15x4::lerp_weight(0.0f)).to_float4(), a.to_float4()));
+        ends = std::max(ends, maxError(vector::q15x4::lerp(a, b, vector::q15x4::lerp_weight(1.0f)).to_float4(), b.to_float4()));
+    }
+    printf("%-16s max error %.3g\n", "lerp 0 and 1", double(ends));
+    if (ends != 0.0f) {
+        fprintf(stderr, "lerp with weight 0 or 1 is not exact\n");
+        failed++;
+    }
+
+    float normal = 0.0f;
+    float add = 0.0f;
+    for (float alpha = 0.0f; alpha <= 1.0f; alpha += 1.0f / 64.0f) {
+        std::vector<vector::float4> out(dst);
+        Compositor::blend(out, src, alpha, Compositor::Normal);
+        for (size_t c = 0; c < n; c++) {
+            normal = std::max(normal, maxError(out[c], vector::float4::lerp(dst[c], src[c], alpha)));
+        }
+
+        out = dst;
+        Compositor::blend(out, src, alpha, Compositor::Add);
+        for (size_t c = 0; c < n; c++) {
+            add = std::max(add, maxError(out[c], saturate(dst[c] + src[c] * alpha)));
+        }
+    }
+    failed += check("blend normal", normal);
+    failed += check("blend add", add);
+
+    return failed ? 1 : 0;
+}
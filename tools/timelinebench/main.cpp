@@ -0,0 +1,230 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Timeline with hundreds of live spans, driven like Pendant::Run(): ProcessEvent() every
+// 1 ms main loop pass, ProcessInterval() and ProcessEffect() then TopEffect().Calc()
+// at 120 Hz, ProcessDisplay() and TopDisplay().Calc() at 60 Hz.
+//
+//   timelinebench [--spans N] [--seconds S]
+//
+// Events re-add themselves from doneFunc like the sensor state machines, effects and
+// displays restart when they expire, one infinite effect sits at the bottom like the
+// main effect. Reports ns per Process and Top call and the Timeline share of one
+// effect frame. Exits non zero when a span started early, an effect frame had no top
+// effect or interval counts are off.
+
+#include "host.h"
+
+#include "timeline.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+static std::mt19937 gen(0x1ED5);
+
+static double uniform(double lo, double hi) {
+    return std::uniform_real_distribution<>(lo, hi)(gen);
+}
+
+static size_t errors = 0;
+
+static void startedAt(Timeline::Span &span) {
+    if (Timeline::SystemTime() < span.time) {
+        errors++;
+    }
+}
+
+struct Timer {
+    double ns = 0.0;
+    uint64_t calls = 0;
+
+    template<class F> void operator()(const F &func) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        ns += double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        calls++;
+    }
+
+    double per() const { return calls ? ns / double(calls) : 0.0; }
+};
+
+int main(int argc, char *argv[]) {
+    size_t spans = 400;
+    double seconds = 60.0;
+
+    for (int c = 1; c < argc; c++) {
+        if (strcmp(argv[c], "--spans") == 0 && c + 1 < argc) {
+            spans = size_t(strtoull(argv[++c], nullptr, 0));
+        } else if (strcmp(argv[c], "--seconds") == 0 && c + 1 < argc) {
+            seconds = strtod(argv[++c], nullptr);
+        } else {
+            fprintf(stderr, "usage: %s [--spans N] [--seconds S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    double now = 1.0;
+    setSystemTime(now);
+    Timeline &timeline(Timeline::instance());
+
+    // Half events, a quarter intervals, the rest effects and displays. The vectors never
+    // grow after this, Timeline keeps pointers.
+    std::vector<Timeline::Event> events(spans / 2);
+    std::vector<Timeline::Interval> intervals(spans / 4);
+    std::vector<Timeline::Effect> effects(spans / 5);
+    std::vector<Timeline::Display> displays(spans - events.size() - intervals.size() - effects.size());
+
+    uint64_t eventStarts = 0;
+    uint64_t eventDones = 0;
+    for (Timeline::Event &e : events) {
+        e.time = now + uniform(0.0, 2.0);
+        e.duration = uniform(0.0, 0.05);
+        e.startFunc = [&](Timeline::Span &span) {
+            startedAt(span);
+            eventStarts++;
+        };
+        e.doneFunc = [&](Timeline::Span &span) {
+            eventDones++;
+            span.time = Timeline::SystemTime() + uniform(0.1, 2.0);
+            timeline.Add(span);
+        };
+        timeline.Add(e);
+    }
+
+    double expectedIntervals = 0.0;
+    uint64_t intervalDones = 0;
+    for (Timeline::Interval &i : intervals) {
+        i.time = now + uniform(0.0, 1.0);
+        i.interval = uniform(0.1, 5.0);
+        i.intervalFuzz = (&i - intervals.data()) & 1 ? 0.0 : i.interval * 0.5;
+        expectedIntervals += seconds / ( i.interval + i.intervalFuzz * 0.5 );
+        i.startFunc = startedAt;
+        i.doneFunc = [&](Timeline::Span &) {
+            intervalDones++;
+        };
+        timeline.Add(i);
+    }
+
+    uint64_t calcs = 0;
+    auto restart = [&](Timeline::Span &span) {
+        span.time = Timeline::SystemTime() + uniform(0.0, 1.0);
+        timeline.Add(span);
+    };
+    auto calc = [&](Timeline::Span &, Timeline::Span &below) {
+        calcs += below.Valid() ? 1 : 0;
+    };
+    for (Timeline::Effect &e : effects) {
+        bool main = &e == effects.data();
+        e.time = main ? now : now + uniform(0.0, 10.0);
+        e.duration = main ? std::numeric_limits<double>::infinity() : uniform(2.0, 20.0);
+        e.attack = 0.5;
+        e.release = 0.5;
+        e.startFunc = startedAt;
+        e.calcFunc = calc;
+        if (!main) {
+            e.doneFunc = restart;
+        }
+        timeline.Add(e);
+    }
+    for (Timeline::Display &d : displays) {
+        d.time = now + uniform(0.0, 10.0);
+        d.duration = uniform(1.0, 10.0);
+        d.startFunc = startedAt;
+        d.calcFunc = calc;
+        d.doneFunc = restart;
+        timeline.Add(d);
+    }
+
+    Timer eventTimer, intervalTimer, effectTimer, effectTopTimer, displayTimer, displayTopTimer;
+    size_t noTop = 0;
+
+    static constexpr double loopTime = 0.001;
+    const double end = now + seconds;
+    double nextEffect = now;
+    double nextDisplay = now;
+    while (now < end) {
+        now += loopTime;
+        setSystemTime(now);
+        eventTimer([&] { timeline.ProcessEvent(); });
+        if (now >= nextEffect) {
+            nextEffect += 1.0 / Timeline::effectRate;
+            intervalTimer([&] { timeline.ProcessInterval(); });
+            effectTimer([&] { timeline.ProcessEffect(); });
+            effectTopTimer([&] {
+                if (timeline.TopEffect().Valid()) {
+                    timeline.TopEffect().Calc();
+                } else {
+                    noTop++;
+                }
+            });
+        }
+        if (now >= nextDisplay) {
+            nextDisplay += 1.0 / Timeline::displayRate;
+            intervalTimer([&] { timeline.ProcessInterval(); });
+            displayTimer([&] { timeline.ProcessDisplay(); });
+            displayTopTimer([&] {
+                if (timeline.TopDisplay().Valid()) {
+                    timeline.TopDisplay().Calc();
+                }
+            });
+        }
+    }
+
+    printf("%zu spans: %zu events, %zu intervals, %zu effects, %zu displays, %g s\n",
+        spans, events.size(), intervals.size(), effects.size(), displays.size(), seconds);
+    printf("  %-28s %10.1f ns\n", "ProcessEvent", eventTimer.per());
+    printf("  %-28s %10.1f ns\n", "ProcessInterval", intervalTimer.per());
+    printf("  %-28s %10.1f ns\n", "ProcessEffect", effectTimer.per());
+    printf("  %-28s %10.1f ns\n", "TopEffect().Calc()", effectTopTimer.per());
+    printf("  %-28s %10.1f ns\n", "ProcessDisplay", displayTimer.per());
+    printf("  %-28s %10.1f ns\n", "TopDisplay().Calc()", displayTopTimer.per());
+    const double total = eventTimer.ns + intervalTimer.ns + effectTimer.ns + effectTopTimer.ns + displayTimer.ns + displayTopTimer.ns;
+    printf("  %-28s %10.2f us\n", "Timeline per effect frame", total / double(effectTimer.calls) / 1000.0);
+    printf("  %llu event starts, %llu interval firings (%.0f expected), %llu calcs with a span below\n",
+        (unsigned long long)eventStarts, (unsigned long long)intervalDones, expectedIntervals, (unsigned long long)calcs);
+
+    int failed = 0;
+    if (errors) {
+        fprintf(stderr, "%zu spans started before their time\n", errors);
+        failed++;
+    }
+    if (noTop) {
+        fprintf(stderr, "%zu effect frames without a top effect\n", noTop);
+        failed++;
+    }
+    // Done runs at most a loop pass late, so each firing slips by up to 1 ms
+    if (fabs(double(intervalDones) - expectedIntervals) > 0.1 * expectedIntervals + double(intervals.size())) {
+        fprintf(stderr, "interval firings off by more than 10%%\n");
+        failed++;
+    }
+    if (eventStarts < eventDones || eventStarts - eventDones > events.size()) {
+        fprintf(stderr, "event starts and dones disagree\n");
+        failed++;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Conformance tests for the script VM: the result of every op, what validate() rejects,
+// and a timing check of the threaded dispatch. Exits non zero on the first failure.
+
+#include "vm.h"
+#include "fastmath.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <initializer_list>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static bool near(float a, float b, float tolerance = 1e-6f) {
+    return std::fabs(a - b) <= tolerance * std::max(1.0f, std::fabs(b));
+}
+
+static VM::Program program(std::initializer_list<VM::Instr> code) {
+    VM::Program p;
+    for (const VM::Instr &i : code) {
+        p.code[p.codeN++] = i;
+    }
+    return p;
+}
+
+// Runs code followed by OUT r29 and returns the registers afterwards
+struct Run {
+    std::array<VM::Reg, VM::regsN> r = { };
+    vector::float4 out;
+};
+
+static Run run(VM::Program p, std::initializer_list<std::pair<uint8_t, float>> in = { }) {
+    p.code[p.codeN++] = { VM::OUT, 0, 29, 0 };
+    Run result;
+    for (const auto &[reg, value] : in) {
+        result.r[reg].f = value;
+    }
+    CHECK(VM::validate(p));
+    result.out = VM::run(p, result.r);
+    return result;
+}
+
+static void ops() {
+    using VM::MOV, VM::LDC, VM::ADD, VM::SUB, VM::MUL, VM::DIV, VM::MAD, VM::MIN, VM::MAX,
+          VM::FRAC, VM::ABS, VM::SIN, VM::POW, VM::SAT, VM::SEL, VM::FIX, VM::FLT, VM::QADD,
+          VM::QSUB, VM::QMUL, VM::GRAD, VM::HUE;
+
+    CHECK(run(program({{ MOV, 8, 0, 0 }}), {{ 0, 1.25f }}).r[8].f == 1.25f);
+
+    {
+        VM::Program p(program({{ LDC, 8, 1, 0 }}));
+        p.constN = 2;
+        p.consts[0] = 1.0f;
+        p.consts[1] = 2.5f;
+        CHECK(run(p).r[8].f == 2.5f);
+    }
+
+    CHECK(run(program({{ ADD, 8, 0, 1 }}), {{ 0, 1.5f }, { 1, 0.25f }}).r[8].f == 1.75f);
+    CHECK(run(program({{ SUB, 8, 0, 1 }}), {{ 0, 1.5f }, { 1, 0.25f }}).r[8].f == 1.25f);
+    CHECK(run(program({{ MUL, 8, 0, 1 }}), {{ 0, 1.5f }, { 1, -2.0f }}).r[8].f == -3.0f);
+    CHECK(near(run(program({{ DIV, 8, 0, 1 }}), {{ 0, 1.0f }, { 1, 3.0f }}).r[8].f, 1.0f / 3.0f));
+    CHECK(run(program({{ MAD, 8, 0, 1 }}), {{ 0, 2.0f }, { 1, 3.0f }, { 8, 1.0f }}).r[8].f == 7.0f);
+    CHECK(run(program({{ MIN, 8, 0, 1 }}), {{ 0, 2.0f }, { 1, -3.0f }}).r[8].f == -3.0f);
+    CHECK(run(program({{ MAX, 8, 0, 1 }}), {{ 0, 2.0f }, { 1, -3.0f }}).r[8].f == 2.0f);
+    CHECK(run(program({{ FRAC, 8, 0, 0 }}), {{ 0, -1.25f }}).r[8].f == 0.75f);
+    CHECK(run(program({{ FRAC, 8, 0, 0 }}), {{ 0, 2.5f }}).r[8].f == 0.5f);
+    CHECK(run(program({{ ABS, 8, 0, 0 }}), {{ 0, -1.5f }}).r[8].f == 1.5f);
+    CHECK(near(run(program({{ SIN, 8, 0, 0 }}), {{ 0, 0.25f }}).r[8].f, 1.0f));
+    CHECK(near(run(program({{ SIN, 8, 0, 0 }}), {{ 0, 0.75f }}).r[8].f, -1.0f));
+    // fast_pow is good to about 13 bits
+    CHECK(near(run(program({{ POW, 8, 0, 1 }}), {{ 0, 0.5f }, { 1, 2.0f }}).r[8].f, 0.25f, 1e-3f));
+    CHECK(run(program({{ SAT, 8, 0, 0 }}), {{ 0, -0.5f }}).r[8].f == 0.0f);
+    CHECK(run(program({{ SAT, 8, 0, 0 }}), {{ 0, 1.5f }}).r[8].f == 1.0f);
+    CHECK(run(program({{ SAT, 8, 0, 0 }}), {{ 0, 0.3f }}).r[8].f == 0.3f);
+    CHECK(run(program({{ SEL, 8, 0, 1 }}), {{ 0, 1.0f }, { 1, 2.0f }, { 8, 0.0f }}).r[8].f == 1.0f);
+    CHECK(run(program({{ SEL, 8, 0, 1 }}), {{ 0, 1.0f }, { 1, 2.0f }, { 8, -0.5f }}).r[8].f == 2.0f);
+
+    CHECK(run(program({{ FIX, 8, 0, 0 }}), {{ 0, 1.5f }}).r[8].i == 98304);
+    CHECK(run(program({{ FIX, 8, 0, 0 }}), {{ 0, -0.25f }}).r[8].i == -16384);
+    CHECK(run(program({{ FIX, 8, 0, 0 }}), {{ 0, 1e6f }}).r[8].i == 32767 * 65536);
+    CHECK(run(program({{ FIX, 8, 0, 0 }}), {{ 0, -1e6f }}).r[8].i == -32768 * 65536);
+    {
+        VM::Program p(program({{ FIX, 8, 0, 0 }, { FIX, 9, 1, 0 }, { QADD, 10, 8, 9 }, { QSUB, 11, 8, 9 },
+                               { QMUL, 12, 8, 9 }, { FLT, 13, 12, 0 }}));
+        Run r(run(p, {{ 0, 1.5f }, { 1, -2.0f }}));
+        CHECK(r.r[10].i == -32768);
+        CHECK(r.r[11].i == 229376);
+        CHECK(r.r[12].i == -196608);
+        CHECK(r.r[13].f == -3.0f);
+    }
+    // Q16 wraps instead of trapping
+    {
+        VM::Program p(program({{ QADD, 10, 8, 9 }}));
+        Run r;
+        r.r[8].i = INT32_MAX;
+        r.r[9].i = 1;
+        p.code[p.codeN++] = { VM::OUT, 0, 29, 0 };
+        VM::run(p, r.r);
+        CHECK(r.r[10].i == INT32_MIN);
+    }
+
+    {
+        const vector::float4 stops[] = { vector::float4(0.0f, 0.1f, -0.1f, 0.0f), vector::float4(1.0f, -0.1f, 0.1f, 1.0f) };
+        VM::Program p(program({{ GRAD, 8, 0, 0 }}));
+        p.gradientN = 1;
+        p.gradients[0] = color::gradient(stops);
+        Run r(run(p, {{ 0, 0.25f }}));
+        vector::float4 expect(p.gradients[0].repeat(0.25f));
+        CHECK(r.r[8].f == expect.x && r.r[9].f == expect.y && r.r[10].f == expect.z);
+    }
+
+    {
+        Run r(run(program({{ HUE, 8, 0, 0 }}), {{ 0, 0.4f }}));
+        vector::float4 expect(color::hue(0.4f));
+        CHECK(r.r[8].f == expect.x && r.r[9].f == expect.y && r.r[10].f == expect.z);
+    }
+
+    // OUT returns a, a+1, a+2 with alpha 1 and stops, nothing after it runs
+    {
+        VM::Program p(program({{ VM::OUT, 0, 4, 0 }, { MOV, 8, 0, 0 }, { VM::OUT, 0, 4, 0 }}));
+        std::array<VM::Reg, VM::regsN> r = { };
+        r[0].f = 9.0f;
+        r[4].f = 0.25f;
+        r[5].f = 0.5f;
+        r[6].f = 0.75f;
+        CHECK(VM::validate(p));
+        vector::float4 out(VM::run(p, r));
+        CHECK(out.x == 0.25f && out.y == 0.5f && out.z == 0.75f && out.w == 1.0f);
+        CHECK(r[8].f == 0.0f);
+    }
+}
+
+static void validation() {
+    const uint8_t last = VM::regsN - 1;
+
+    CHECK(VM::validate(program({{ VM::OUT, 0, 0, 0 }})));
+    CHECK(VM::validate(program({{ VM::OUT, 0, last - 2, 0 }})));
+
+    // Empty and oversized
+    CHECK(!VM::validate(program({ })));
+    {
+        VM::Program p(program({{ VM::OUT, 0, 0, 0 }}));
+        p.codeN = VM::codeMax + 1;
+        CHECK(!VM::validate(p));
+    }
+    {
+        VM::Program p(program({{ VM::OUT, 0, 0, 0 }}));
+        p.constN = VM::constMax + 1;
+        CHECK(!VM::validate(p));
+        p.constN = 0;
+        p.gradientN = VM::gradientMax + 1;
+        CHECK(!VM::validate(p));
+    }
+
+    // Unknown op
+    CHECK(!VM::validate(program({{ VM::OpCount, 0, 0, 0 }, { VM::OUT, 0, 0, 0 }})));
+
+    // Registers out of range, in every operand
+    CHECK(!VM::validate(program({{ VM::ADD, VM::regsN, 0, 0 }, { VM::OUT, 0, 0, 0 }})));
+    CHECK(!VM::validate(program({{ VM::ADD, 0, VM::regsN, 0 }, { VM::OUT, 0, 0, 0 }})));
+    CHECK(!VM::validate(program({{ VM::ADD, 0, 0, VM::regsN }, { VM::OUT, 0, 0, 0 }})));
+    CHECK(VM::validate(program({{ VM::ADD, last, last, last }, { VM::OUT, 0, 0, 0 }})));
+
+    // LDC past the constants
+    {
+        VM::Program p(program({{ VM::LDC, 8, 2, 0 }, { VM::OUT, 0, 0, 0 }}));
+        p.constN = 2;
+        CHECK(!VM::validate(p));
+        p.constN = 3;
+        CHECK(VM::validate(p));
+    }
+
+    // GRAD past the gradients, or writing past the last register
+    {
+        VM::Program p(program({{ VM::GRAD, 8, 0, 1 }, { VM::OUT, 0, 0, 0 }}));
+        p.gradientN = 1;
+        CHECK(!VM::validate(p));
+        p.gradientN = 2;
+        CHECK(VM::validate(p));
+        p.code[0].d = last - 1;
+        CHECK(!VM::validate(p));
+        p.code[0].d = last - 2;
+        CHECK(VM::validate(p));
+    }
+
+    // HUE writing past the last register
+    CHECK(!VM::validate(program({{ VM::HUE, last - 1, 0, 0 }, { VM::OUT, 0, 0, 0 }})));
+    CHECK(VM::validate(program({{ VM::HUE, last - 2, 0, 0 }, { VM::OUT, 0, 0, 0 }})));
+
+    // OUT reading past the last register
+    CHECK(!VM::validate(program({{ VM::OUT, 0, last - 1, 0 }})));
+
+    // No trailing OUT, run() would walk off the end
+    CHECK(!VM::validate(program({{ VM::MOV, 8, 0, 0 }})));
+    CHECK(!VM::validate(program({{ VM::OUT, 0, 0, 0 }, { VM::MOV, 8, 0, 0 }})));
+}
+
+// A typical program, a gradient scrolled around the ring with a bit of sparkle
+static void timing() {
+    using VM::LDC, VM::MUL, VM::ADD, VM::MAD, VM::FRAC, VM::SIN, VM::SAT, VM::GRAD, VM::MAX;
+
+    const vector::float4 stops[] = { vector::float4(0.2f, 0.1f, -0.1f, 0.0f), vector::float4(0.8f, -0.1f, 0.1f, 0.5f),
+                                     vector::float4(0.2f, 0.1f, -0.1f, 1.0f) };
+    VM::Program p(program({
+        { LDC, 8, 0, 0 },                          // speed
+        { MUL, 9, VM::InTime, 8 },
+        { ADD, 9, 9, VM::InIndex },
+        { FRAC, 9, 9, 0 },
+        { GRAD, 10, 9, 0 },
+        { SIN, 13, 9, 0 },
+        { LDC, 14, 1, 0 },
+        { MUL, 13, 13, 14 },
+        { SAT, 13, 13, 0 },
+        { MAD, 10, 13, 14 },
+        { LDC, 15, 2, 0 },
+        { ADD, 16, VM::InRandom, 15 },
+        { SAT, 16, 16, 0 },
+        { MAX, 10, 10, 16 },
+        { VM::OUT, 0, 10, 0 }
+    }));
+    p.constN = 3;
+    p.consts[0] = 0.25f;
+    p.consts[1] = 0.1f;
+    p.consts[2] = -0.98f;
+    p.gradientN = 1;
+    p.gradients[0] = color::gradient(stops);
+    CHECK(VM::validate(p));
+
+    static constexpr size_t ledsN = 80;
+    static constexpr size_t framesN = 2000;
+    std::array<VM::Reg, VM::regsN> r = { };
+    volatile float sink = 0.0f;
+    double worst = 0.0;
+    double total = 0.0;
+    for (size_t f = 0; f < framesN; f++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t c = 0; c < ledsN; c++) {
+            r[VM::InTime].f = float(f) * (1.0f / 120.0f);
+            r[VM::InIndex].f = float(c) * (1.0f / float(ledsN));
+            r[VM::InRandom].f = float(c * 37 % 101) * (1.0f / 101.0f);
+            sink = sink + VM::run(p, r).x;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double us = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) * 1e-3;
+        total += us;
+        worst = std::max(worst, us);
+    }
+
+    const double avg = total / double(framesN);
+    printf("%zu instructions x %zu LEDs: %.2f us/frame avg, %.2f us worst, %.2f ns/instruction\n",
+           size_t(p.codeN), ledsN, avg, worst, avg * 1e3 / double(p.codeN * ledsN));
+    // The device budget is 1 ms per frame. The host is far faster, so this only catches
+    // dispatch falling off a cliff, the profiler page has the real number.
+    CHECK(avg < 1000.0);
+}
+
+int main() {
+    ops();
+    validation();
+    timing();
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks convert::OKLAB2WS2816 against the float path Leds::prepare used before it,
+// OKLAB2LED(in * brightness).clamp() then fix_for_ws2816(), at every brightness level,
+// and times both per LED.
+//
+// The 384 knee maps codes below 384 onto 0..255, so a one code difference right at the
+// knee shows up as 129 codes. Errors are measured with the knee undone to stay linear.
+
+#include "color.h"
+#include "model.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// In linear 16-bit codes
+static constexpr int32_t tolerance = 32;
+
+static int32_t unknee(uint16_t v) {
+    return v < 256 ? ( int32_t(v) * 384 + 128 ) / 256 : int32_t(v);
+}
+
+static color::rgba<uint16_t> reference(const color::convert &converter, const vector::float4 &in, float brightness) {
+    return color::rgba<uint16_t>(converter.OKLAB2LED(in * brightness).clamp()).fix_for_ws2816();
+}
+
+template<class F> static double nsPerLed(size_t n, const F &func) {
+    double best = 1e30;
+    for (size_t pass = 0; pass < 20; pass++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) / double(n));
+    }
+    return best;
+}
+
+int main() {
+    static constexpr color::convert converter;
+
+    // Every sRGB8 corner and edge at a coarse step plus random colors, through the
+    // same conversion the effects use
+    std::vector<vector::float4> in;
+    for (uint32_t r = 0; r < 256; r += 15) {
+        for (uint32_t g = 0; g < 256; g += 15) {
+            for (uint32_t b = 0; b < 256; b += 15) {
+                in.push_back(vector::float4(converter.sRGB2OKLAB(color::rgba<uint8_t>(uint8_t(r), uint8_t(g), uint8_t(b))), 1.0f));
+            }
+        }
+    }
+    std::mt19937 gen(0x5EED);
+    std::uniform_int_distribution<uint32_t> dis(0, 255);
+    for (size_t c = 0; c < 65536; c++) {
+        in.push_back(vector::float4(converter.sRGB2OKLAB(color::rgba<uint8_t>(uint8_t(dis(gen)), uint8_t(dis(gen)), uint8_t(dis(gen)))), 1.0f));
+    }
+
+    std::vector<color::rgba<uint16_t>> out(in.size());
+    color::led_transfer transfer;
+    Model &model(Model::instance());
+
+    int failed = 0;
+    printf("level brightness  max error  at LED  float ns/LED  kernel ns/LED\n");
+    for (size_t level = 0; level < model.BrightnessLevelCount(); level++) {
+        model.SetBrightnessLevel(level);
+        const float brightness = model.Brightness();
+        transfer.set(brightness);
+
+        converter.OKLAB2WS2816(in.data(), out.data(), in.size(), transfer);
+
+        int32_t worst = 0;
+        size_t worstAt = 0;
+        for (size_t c = 0; c < in.size(); c++) {
+            color::rgba<uint16_t> expect(reference(converter, in[c], brightness));
+            int32_t e = std::max(std::max(std::abs(unknee(out[c].r) - unknee(expect.r)),
+                                          std::abs(unknee(out[c].g) - unknee(expect.g))),
+                                          std::abs(unknee(out[c].b) - unknee(expect.b)));
+            if (e > worst) {
+                worst = e;
+                worstAt = c;
+            }
+        }
+
+        // One frame worth of LEDs at a time, like Leds::prepare
+        static constexpr size_t frameN = 80;
+        volatile uint32_t sink = 0;
+        double floatNs = nsPerLed(frameN * 64, [&] {
+            for (size_t f = 0; f < 64; f++) {
+                for (size_t c = 0; c < frameN; c++) {
+                    out[c] = reference(converter, in[f * frameN + c], brightness);
+                }
+                sink = sink + out[0].r;
+            }
+        });
+        double kernelNs = nsPerLed(frameN * 64, [&] {
+            for (size_t f = 0; f < 64; f++) {
+                converter.OKLAB2WS2816(&in[f * frameN], out.data(), frameN, transfer);
+                sink = sink + out[0].r;
+            }
+        });
+
+        printf("%5zu %10.4f  %9d  %6zu  %12.2f  %13.2f\n", level, double(brightness), int(worst), worstAt, floatNs, kernelNs);
+        if (worst > tolerance) {
+            fprintf(stderr, "Level %zu: error %d over tolerance %d\n", level, int(worst), int(tolerance));
+            failed++;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
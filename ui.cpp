@@ -27,6 +27,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./bq25895.h"
 #include "./model.h"
 #include "./leds.h"
+#include "./profiler.h"
 
 #include <stdio.h>
 
@@ -240,6 +241,76 @@ void UI::enterColorPrefs(Timeline::Span &) {
     Timeline::instance().Add(colorEffect);
 }
 
+void UI::enterProfiler(Timeline::Span &) {
+    static Timeline::Display profilerDisplay;
+
+    static uint32_t effect = 0;
+    static uint32_t stage = 0;
+    static bool skipRelease = false;
+
+    effect = Model::instance().Effect();
+    stage = Profiler::Frame;
+    // We are entered with switch 1 still held
+    skipRelease = true;
+
+    profilerDisplay.time = Timeline::SystemTime();
+    profilerDisplay.duration = 10.0; // timeout
+    profilerDisplay.calcFunc = [=](Timeline::Span &, Timeline::Span &) {
+        const Profiler &profiler(Profiler::instance());
+        const Profiler::Stats &stats(profiler.stats(effect, Profiler::Stage(stage)));
+
+        SDD1306::instance().ClearChar();
+
+        char str[32];
+        sprintf(str, "%02d %-4s", int(effect), Profiler::stageName(Profiler::Stage(stage)));
+        SDD1306::instance().PlaceUTF8String(0,0,str);
+        sprintf(str, "a%5dus", int(profiler.micros(stats.avg())));
+        SDD1306::instance().PlaceUTF8String(0,1,str);
+        sprintf(str, "m%5dus", int(profiler.micros(stats.max)));
+        SDD1306::instance().PlaceUTF8String(0,2,str);
+        // p95 as a share of the frame budget
+        sprintf(str, "95:%3d%%", int(uint64_t(stats.percentile(95)) * 100 / profiler.budget()));
+        SDD1306::instance().PlaceUTF8String(0,3,str);
+    };
+
+    profilerDisplay.commitFunc = [=](Timeline::Span &) {
+        SDD1306::instance().Display();
+    };
+
+    profilerDisplay.doneFunc = [this](Timeline::Span &) {
+        FlipAnimation(&profilerDisplay);
+    };
+
+    profilerDisplay.switch1Func = [=](Timeline::Span &, bool up) {
+        if (up) {
+            if (skipRelease) {
+                skipRelease = false;
+                return;
+            }
+            profilerDisplay.time = Timeline::SystemTime(); // reset timeout
+            effect ++;
+            effect %= Model::effectCount;
+        }
+    };
+
+    profilerDisplay.switch2Func = [=](Timeline::Span &, bool up) {
+        if (up) {
+            profilerDisplay.time = Timeline::SystemTime(); // reset timeout
+            stage ++;
+            stage %= Profiler::StageCount;
+        }
+    };
+
+    profilerDisplay.switch3Func = [=](Timeline::Span &, bool up) {
+        if (up) {
+            profilerDisplay.time = Timeline::SystemTime(); // reset timeout
+            Profiler::instance().dump();
+        }
+    };
+
+    Timeline::instance().Add(profilerDisplay);
+}
+
 void UI::init() {
     static Timeline::Display mainUI;
     if (!Timeline::instance().Scheduled(mainUI)) {
@@ -277,14 +348,22 @@ void UI::init() {
         mainUI.commitFunc = [=](Timeline::Span &) {
             SDD1306::instance().Display();
         };
+        // Switch 2 while switch 1 is held opens the profiler page
+        static bool switch1Held = false;
         mainUI.switch1Func = [=](Timeline::Span &, bool up) {
+            switch1Held = !up;
             if (up) { 
                 Model::instance().SetEffect((Model::instance().Effect() + 1) % Model::instance().EffectCount());
             }
         };
         mainUI.switch2Func = [this](Timeline::Span &span, bool up) {
             if (up) { 
-                enterColorPrefs(span);
+                if (switch1Held) {
+                    switch1Held = false;
+                    enterProfiler(span);
+                } else {
+                    enterColorPrefs(span);
+                }
             }
         };
         mainUI.switch3Func = [=](Timeline::Span &, bool up) {
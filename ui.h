@@ -32,6 +32,7 @@ public:
 private:
     void FlipAnimation(Timeline::Span *parent);
     void enterColorPrefs(Timeline::Span &);
+    void enterProfiler(Timeline::Span &);
     void init();
     bool initialized = false;
 };
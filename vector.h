@@ -465,6 +465,85 @@ namespace vector {
             return i;
         }
     };
+
+    // Four Q15 channels, two packed per word so the M4 DSP instructions work on pairs.
+    // Channels saturate to [-1, 1), weights are Q14 so 1.0 is exact.
+    struct q15x4 {
+        uint32_t xy = 0;
+        uint32_t zw = 0;
+
+        constexpr q15x4() {
+        }
+
+        constexpr q15x4(uint32_t _xy, uint32_t _zw) :
+            xy(_xy),
+            zw(_zw) {
+        }
+
+        explicit q15x4(const float4 &f) :
+            xy(pack(q15(f.x), q15(f.y))),
+            zw(pack(q15(f.z), q15(f.w))) {
+        }
+
+        float4 to_float4() const {
+            return float4(float(int16_t(xy & 0xFFFF)) * (1.0f / 32768.0f),
+                          float(int16_t(xy >> 16   )) * (1.0f / 32768.0f),
+                          float(int16_t(zw & 0xFFFF)) * (1.0f / 32768.0f),
+                          float(int16_t(zw >> 16   )) * (1.0f / 32768.0f));
+        }
+
+        // Packed (1 - v, v) for lerp(), v in [0, 1]
+        static uint32_t lerp_weight(float v) {
+            uint32_t t = uint32_t(q14(std::clamp(v, 0.0f, 1.0f)));
+            return ( t << 16 ) | ( 16384 - t );
+        }
+
+        // v in the low halfword for scale()
+        static uint32_t scale_weight(float v) {
+            return uint32_t(q14(v)) & 0xFFFF;
+        }
+
+        // Saturating, one QADD16 per pair of channels
+        static q15x4 add(const q15x4 &a, const q15x4 &b) {
+            return q15x4(__QADD16(a.xy, b.xy), __QADD16(a.zw, b.zw));
+        }
+
+        // a * v with w from scale_weight(v)
+        static q15x4 scale(const q15x4 &a, uint32_t w) {
+            return q15x4(pack(int32_t(__SMUAD(a.xy, w)) >> 14, int32_t(__SMUADX(a.xy, w)) >> 14),
+                         pack(int32_t(__SMUAD(a.zw, w)) >> 14, int32_t(__SMUADX(a.zw, w)) >> 14));
+        }
+
+        // a * (1 - v) + b * v with w from lerp_weight(v), one SMUAD per channel
+        static q15x4 lerp(const q15x4 &a, const q15x4 &b, uint32_t w) {
+            return q15x4(lerp(a.xy, b.xy, w), lerp(a.zw, b.zw, w));
+        }
+
+    private:
+        // CMSIS takes and returns the raw register bits
+        static int32_t ssat16(int32_t v) {
+            return int32_t(__SSAT(uint32_t(v), 16));
+        }
+
+        static int32_t q15(float v) {
+            return ssat16(int32_t(v * 32768.0f));
+        }
+
+        static int32_t q14(float v) {
+            return ssat16(int32_t(v * 16384.0f));
+        }
+
+        static uint32_t pack(int32_t lo, int32_t hi) {
+            return __PKHBT(uint32_t(ssat16(lo)), uint32_t(ssat16(hi)), 16);
+        }
+
+        // Pairs up the low and the high channels of a and b, then weights each pair
+        static uint32_t lerp(uint32_t a, uint32_t b, uint32_t w) {
+            uint32_t lo = __PKHBT(a, b, 16);
+            uint32_t hi = __PKHTB(b, a, 16);
+            return pack(int32_t(__SMUAD(lo, w)) >> 14, int32_t(__SMUAD(hi, w)) >> 14);
+        }
+    };
 }
 
 #endif  // #ifndef _VECTOR_H_
@@ -0,0 +1,326 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./vm.h"
+#include "./leds.h"
+#include "./player.h"
+#include "./sdcard.h"
+#include "./timeline.h"
+#include "./fastmath.h"
+
+#include <math.h>
+#include <stdio.h>
+
+VM &VM::instance() {
+    static VM vm;
+    if (!vm.initialized) {
+        vm.initialized = true;
+        vm.init();
+    }
+    return vm;
+}
+
+void VM::init() {
+    if (SDCard::instance().dataFilePresent() && loadDirectory()) {
+        printf("VM: %d programs in data.bin\n", int(count));
+    }
+    Model::instance().SetScriptEffectCount(uint32_t(count));
+    // A script effect saved last time might be gone now
+    if (Model::instance().Effect() >= Model::instance().EffectCount()) {
+        Model::instance().SetEffect(0);
+    }
+    printf("VM initialized.\n");
+}
+
+bool VM::loadDirectory() {
+    uint32_t header[2] = { };
+    if (!SDCard::instance().readFromDataFile(reinterpret_cast<uint8_t *>(header), 0, sizeof(header)) ||
+        header[0] != directoryMagic) {
+        return false;
+    }
+    count = std::min(size_t(header[1]), offsets.size());
+    if (!SDCard::instance().readFromDataFile(reinterpret_cast<uint8_t *>(offsets.data()), sizeof(header), count * sizeof(uint32_t))) {
+        count = 0;
+        return false;
+    }
+    for (size_t c = 0; c < count; c++) {
+        uint32_t magic = 0;
+        SDCard::instance().readFromDataFile(reinterpret_cast<uint8_t *>(&magic), offsets[c], sizeof(magic));
+        animation[c] = magic == Player::animationMagic;
+    }
+    return true;
+}
+
+bool VM::load(size_t index, Program &program) {
+    size_t offset = offsets[index];
+    auto read = [&offset](void *dst, size_t size) {
+        bool ok = SDCard::instance().readFromDataFile(static_cast<uint8_t *>(dst), offset, size);
+        offset += size;
+        return ok;
+    };
+
+    struct {
+        uint32_t magic;
+        uint16_t codeN;
+        uint8_t constN;
+        uint8_t gradientN;
+    } header;
+    if (!read(&header, sizeof(header)) ||
+        header.magic != programMagic ||
+        header.codeN > codeMax ||
+        header.constN > constMax ||
+        header.gradientN > gradientMax) {
+        return false;
+    }
+    program.codeN = header.codeN;
+    program.constN = header.constN;
+    program.gradientN = header.gradientN;
+
+    if (!read(program.consts.data(), program.constN * sizeof(float))) {
+        return false;
+    }
+
+    for (size_t g = 0; g < program.gradientN; g++) {
+        uint32_t stopN = 0;
+        if (!read(&stopN, sizeof(stopN)) || stopN < 2 || stopN > color::gradient::stops_max) {
+            return false;
+        }
+        struct {
+            uint32_t rgb;
+            float position;
+        } stops[color::gradient::stops_max];
+        if (!read(stops, stopN * sizeof(stops[0]))) {
+            return false;
+        }
+        std::array<vector::float4, color::gradient::stops_max> converted;
+        for (size_t c = 0; c < stopN; c++) {
+            converted[c] = color::srgb8_stop(stops[c].rgb, stops[c].position);
+        }
+        program.gradients[g] = color::gradient(std::span(converted.data(), stopN));
+    }
+
+    if (!read(program.code.data(), program.codeN * sizeof(Instr))) {
+        return false;
+    }
+
+    return validate(program);
+}
+
+bool VM::validate(const Program &program) {
+    if (program.codeN == 0 || program.codeN > codeMax ||
+        program.constN > constMax || program.gradientN > gradientMax) {
+        return false;
+    }
+    for (size_t c = 0; c < program.codeN; c++) {
+        const Instr &i(program.code[c]);
+        if (i.op >= OpCount || i.d >= regsN || i.a >= regsN || i.b >= regsN) {
+            return false;
+        }
+        switch (i.op) {
+            case LDC:
+                if (i.a >= program.constN) return false;
+            break;
+            case GRAD:
+                if (i.b >= program.gradientN || i.d + 2U >= regsN) return false;
+            break;
+            case HUE:
+                if (i.d + 2U >= regsN) return false;
+            break;
+            case OUT:
+                if (i.a + 2U >= regsN) return false;
+            break;
+            default:
+            break;
+        }
+    }
+    return program.code[program.codeN - 1].op == OUT;
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+vector::float4 VM::run(const Program &program, std::array<Reg, regsN> &r) {
+    // Threaded dispatch, each handler jumps straight to the next one, same order as Op
+    static void *const dispatch[] = {
+        &&op_mov, &&op_ldc, &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mad, &&op_min,
+        &&op_max, &&op_frac, &&op_abs, &&op_sin, &&op_pow, &&op_sat, &&op_sel, &&op_fix,
+        &&op_flt, &&op_qadd, &&op_qsub, &&op_qmul, &&op_grad, &&op_hue, &&op_out
+    };
+    static_assert(std::size(dispatch) == OpCount, "dispatch table out of sync with Op");
+
+    const Instr *pc = program.code.data();
+    const Instr *i = pc;
+
+#define NEXT() i = pc++; goto *dispatch[i->op]
+
+    NEXT();
+
+op_mov:
+    r[i->d].f = r[i->a].f;
+    NEXT();
+op_ldc:
+    r[i->d].f = program.consts[i->a];
+    NEXT();
+op_add:
+    r[i->d].f = r[i->a].f + r[i->b].f;
+    NEXT();
+op_sub:
+    r[i->d].f = r[i->a].f - r[i->b].f;
+    NEXT();
+op_mul:
+    r[i->d].f = r[i->a].f * r[i->b].f;
+    NEXT();
+op_div:
+    r[i->d].f = r[i->a].f * fast_rcp(r[i->b].f);
+    NEXT();
+op_mad:
+    r[i->d].f += r[i->a].f * r[i->b].f;
+    NEXT();
+op_min:
+    r[i->d].f = std::min(r[i->a].f, r[i->b].f);
+    NEXT();
+op_max:
+    r[i->d].f = std::max(r[i->a].f, r[i->b].f);
+    NEXT();
+op_frac:
+    r[i->d].f = r[i->a].f - floorf(r[i->a].f);
+    NEXT();
+op_abs:
+    r[i->d].f = fabsf(r[i->a].f);
+    NEXT();
+op_sin:
+    r[i->d].f = sinf(r[i->a].f * 2.0f * float(std::numbers::pi));
+    NEXT();
+op_pow:
+    r[i->d].f = fast_pow(r[i->a].f, r[i->b].f);
+    NEXT();
+op_sat:
+    r[i->d].f = std::clamp(r[i->a].f, 0.0f, 1.0f);
+    NEXT();
+op_sel:
+    r[i->d].f = r[i->d].f >= 0.0f ? r[i->a].f : r[i->b].f;
+    NEXT();
+op_fix:
+    r[i->d].i = int32_t(std::clamp(r[i->a].f, -32768.0f, 32767.0f) * 65536.0f);
+    NEXT();
+op_flt:
+    r[i->d].f = float(r[i->a].i) * ( 1.0f / 65536.0f );
+    NEXT();
+op_qadd:
+    r[i->d].i = int32_t(uint32_t(r[i->a].i) + uint32_t(r[i->b].i));
+    NEXT();
+op_qsub:
+    r[i->d].i = int32_t(uint32_t(r[i->a].i) - uint32_t(r[i->b].i));
+    NEXT();
+op_qmul:
+    r[i->d].i = int32_t(( int64_t(r[i->a].i) * int64_t(r[i->b].i) ) >> 16);
+    NEXT();
+op_grad: {
+    vector::float4 c(program.gradients[i->b].repeat(r[i->a].f));
+    r[i->d + 0].f = c.x;
+    r[i->d + 1].f = c.y;
+    r[i->d + 2].f = c.z;
+    NEXT();
+}
+op_hue: {
+    vector::float4 c(color::hue(r[i->a].f));
+    r[i->d + 0].f = c.x;
+    r[i->d + 1].f = c.y;
+    r[i->d + 2].f = c.z;
+    NEXT();
+}
+op_out:
+    return vector::float4(r[i->a + 0].f, r[i->a + 1].f, r[i->a + 2].f, 1.0f);
+
+#undef NEXT
+}
+
+VM::Program *VM::program(size_t index) {
+    if (index >= count) {
+        return nullptr;
+    }
+    for (size_t c = 0; c < slotsN; c++) {
+        if (slotIndex[c] == int32_t(index)) {
+            return &slots[c];
+        }
+    }
+    // A program which failed to load is not retried until it is selected again
+    size_t slot = slotNext;
+    slotNext = ( slotNext + 1 ) % slotsN;
+    slotIndex[slot] = int32_t(index);
+    if (!load(index, slots[slot])) {
+        printf("VM: program %d is invalid\n", int(index));
+        slots[slot].codeN = 0;
+    }
+    return &slots[slot];
+}
+
+void VM::release(size_t index) {
+    if (index < count && animation[index]) {
+        Player::instance().close(offsets[index]);
+    }
+}
+
+void VM::calc(size_t index) {
+    Leds &leds(Leds::instance());
+
+    if (index < count && animation[index]) {
+        Player::instance().calc(offsets[index]);
+        return;
+    }
+
+    Program *p = program(index);
+    if (!p || p->codeN == 0) {
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            Leds::fill(leds.circle(s), color::srgb8({0x00,0x00,0x00}));
+            Leds::fill(leds.bird(s), color::srgb8({0x00,0x00,0x00}));
+        }
+        return;
+    }
+
+    std::array<Reg, regsN> regs = { };
+    // Wraps every hour to keep float precision
+    regs[InTime].f = float(fmod(Timeline::SystemTime(), 3600.0));
+
+    auto led = [&](const vector::float4 &pos, size_t c, float bird) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        regs[InX].f = pos.x;
+        regs[InY].f = pos.y;
+        regs[InAngle].f = pos.w;
+        regs[InIndex].f = pos.z;
+        regs[InRandom].f = float(rng >> 8) * ( 1.0f / 16777216.0f );
+        regs[InLed].f = float(c);
+        regs[InBird].f = bird;
+        return run(*p, regs);
+    };
+
+    for (size_t s = 0; s < Leds::sidesN; s++) {
+        auto circle = leds.circle(s);
+        for (size_t c = 0; c < Leds::circleLedsN; c++) {
+            circle[c] = led(Leds::map.getCircle(s, c), c, 0.0f);
+        }
+        auto bird = leds.bird(s);
+        for (size_t c = 0; c < Leds::birdLedsN; c++) {
+            bird[c] = led(Leds::map.getBird(s, c), c, 1.0f);
+        }
+    }
+}
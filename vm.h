@@ -0,0 +1,151 @@
+/*
+Copyright 2020 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef VM_H_
+#define VM_H_
+
+#include "./color.h"
+#include "./model.h"
+
+#include <array>
+#include <cstdint>
+
+// Register based bytecode for effects which are loaded from data.bin on the SD card.
+// Directory entries can also point to a Player animation.
+//
+// data.bin starts with a directory:
+//   uint32_t magic ('PVM1'), uint32_t count, uint32_t offset[count]
+// and each program at its offset is, all little endian:
+//   uint32_t magic ('PVMP'), uint16_t codeN, uint8_t constN, uint8_t gradientN
+//   float const[constN]
+//   gradientN times: uint32_t stopN, stopN times { uint32_t rgb, float position }
+//   uint32_t code[codeN], op | d << 8 | a << 16 | b << 24
+//
+// A program runs once per LED and ends with OUT. r0-r7 hold the LED inputs, see Input.
+// Registers hold either a float or a Q16 fixed point value, the op decides which.
+class VM {
+public:
+    static VM &instance();
+
+    static constexpr uint32_t directoryMagic = 0x314D5650; // 'PVM1'
+    static constexpr uint32_t programMagic = 0x504D5650; // 'PVMP'
+
+    static constexpr size_t regsN = 32;
+    static constexpr size_t codeMax = 128;
+    static constexpr size_t constMax = 32;
+    static constexpr size_t gradientMax = 4;
+
+    enum Op : uint8_t {
+        MOV,    // d = a
+        LDC,    // d = const[a]
+        ADD,    // d = a + b
+        SUB,    // d = a - b
+        MUL,    // d = a * b
+        DIV,    // d = a / b
+        MAD,    // d = d + a * b
+        MIN,    // d = min(a, b)
+        MAX,    // d = max(a, b)
+        FRAC,   // d = a - floor(a)
+        ABS,    // d = |a|
+        SIN,    // d = sin(2pi * a)
+        POW,    // d = a ^ b
+        SAT,    // d = clamp(a, 0, 1)
+        SEL,    // d = d >= 0 ? a : b
+        FIX,    // d = Q16(a)
+        FLT,    // d = float(Q16 a)
+        QADD,   // d = a + b, Q16
+        QSUB,   // d = a - b, Q16
+        QMUL,   // d = a * b, Q16
+        GRAD,   // d, d+1, d+2 = gradient[b].repeat(a)
+        HUE,    // d, d+1, d+2 = color::hue(a)
+        OUT,    // color = a, a+1, a+2, stop
+        OpCount
+    };
+
+    enum Input {
+        InX,        // Leds::map position
+        InY,
+        InAngle,    // map w
+        InIndex,    // map z, ring position in [0, 1)
+        InTime,     // seconds
+        InRandom,   // [0, 1), new for every LED and frame
+        InLed,      // LED number in its ring or bird
+        InBird,     // 1 for bird LEDs, 0 for the ring
+        InputCount
+    };
+
+    union Reg {
+        float f;
+        int32_t i;
+    };
+
+    struct Instr {
+        uint8_t op;
+        uint8_t d;
+        uint8_t a;
+        uint8_t b;
+    };
+
+    struct Program {
+        size_t codeN = 0;
+        size_t constN = 0;
+        size_t gradientN = 0;
+        std::array<Instr, codeMax> code;
+        std::array<float, constMax> consts;
+        std::array<color::gradient, gradientMax> gradients;
+    };
+
+    // Every operand in range and the last instruction is OUT, so run() always terminates
+    static bool validate(const Program &program);
+
+    // One LED, regs holds the inputs on entry
+    static vector::float4 run(const Program &program, std::array<Reg, regsN> &regs);
+
+    size_t programCount() const { return count; }
+
+    // One frame of script effect index into Leds
+    void calc(size_t index);
+    // Script effect index is not shown any more, drops what it holds open
+    void release(size_t index);
+
+private:
+    static constexpr size_t slotsN = 2; // current and previous effect while cross-fading
+
+    bool loadDirectory();
+    bool load(size_t index, Program &program);
+    Program *program(size_t index);
+
+    std::array<uint32_t, Model::scriptEffectMax> offsets = { };
+    std::array<bool, Model::scriptEffectMax> animation = { }; // played by Player instead
+    size_t count = 0;
+
+    std::array<Program, slotsN> slots;
+    std::array<int32_t, slotsN> slotIndex = { -1, -1 };
+    size_t slotNext = 0;
+
+    uint32_t rng = 0x9E3779B9;
+
+    void init();
+    bool initialized = false;
+};
+
+#endif /* VM_H_ */